@@ -0,0 +1,73 @@
+/**
+ * @file batch.c
+ * @brief Implementacion de la codificacion de series de muestras.
+ */
+
+#include "batch.h"
+
+/**
+ * @brief Varint de 64 bits para los tokens de las series, que ocupan hasta 33 bits (5 bytes)
+ */
+static int batch_put_token(uint8_t* buf, uint64_t value)
+{
+    int len = 0;
+
+    while(value >= 0x80){
+        buf[len++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buf[len++] = value;
+    return len;
+}
+
+/**
+ * @brief Zig-zag sobre la representacion sin signo, sin desplazamientos de valores negativos
+ */
+static uint32_t batch_zigzag(uint32_t value)
+{
+    return (value << 1) ^ (0u - (value >> 31));
+}
+
+int batch_put_uvarint(uint8_t* buf, uint32_t value)
+{
+    int len = 0;
+
+    while(value >= 0x80){
+        buf[len++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buf[len++] = value;
+    return len;
+}
+
+int batch_put_svarint(uint8_t* buf, int32_t value)
+{
+    return batch_put_uvarint(buf, batch_zigzag((uint32_t)value));
+}
+
+int batch_put_series(uint8_t* buf, int decimals, const int32_t* values, int count)
+{
+    int len = 0;
+    uint32_t zeros = 0;
+
+    len += batch_put_uvarint(buf + len, decimals);
+    len += batch_put_svarint(buf + len, count > 0 ? values[0] : 0);
+
+    for(int i = 1; i < count; i++){
+        // Diferencia modulo 2^32: no desborda y el decodificador la deshace sumando modulo 2^32
+        uint32_t delta = (uint32_t)values[i] - (uint32_t)values[i - 1];
+        if(delta == 0){
+            zeros++;
+            continue;
+        }
+        if(zeros > 0){
+            len += batch_put_token(buf + len, ((uint64_t)zeros << 1) | 1);
+            zeros = 0;
+        }
+        // El bit 0 distingue los deltas (par) de los tramos de ceros (impar)
+        len += batch_put_token(buf + len, (uint64_t)batch_zigzag(delta) << 1);
+    }
+    if(zeros > 0) len += batch_put_token(buf + len, ((uint64_t)zeros << 1) | 1);
+
+    return len;
+}
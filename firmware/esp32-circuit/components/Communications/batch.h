@@ -0,0 +1,36 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/**
+ * @file batch.h
+ * @brief Codificacion compacta de series de muestras: deltas con zig-zag varint y tramos sin cambios
+ * @details Cada funcion escribe en buf y devuelve el numero de bytes escritos; el llamador reserva
+ * espacio suficiente (como maximo 5 bytes por varint).
+ */
+
+#include <stdint.h>
+
+#define BATCH_VERSION 1
+
+/**
+ * @brief Entero sin signo en base 128, 7 bits por byte empezando por los de menor peso
+ */
+int batch_put_uvarint(uint8_t* buf, uint32_t value);
+
+/**
+ * @brief Entero con signo en zig-zag (0, -1, 1, -2... -> 0, 1, 2, 3...) y despues varint
+ */
+int batch_put_svarint(uint8_t* buf, int32_t value);
+
+/**
+ * @brief Serie de count valores en punto fijo:
+ * uvarint decimals, svarint values[0] y despues los deltas values[i] - values[i - 1] como tokens:
+ * - token par: un delta distinto de cero, zigzag(delta) << 1
+ * - token impar: (n << 1) | 1, n deltas seguidos iguales a cero
+ *
+ * Los deltas se calculan modulo 2^32 y se leen como int32_t, asi que cualquier serie de int32_t
+ * es representable; un token ocupa hasta 33 bits y se escribe como varint de 64 bits (5 bytes).
+ */
+int batch_put_series(uint8_t* buf, int decimals, const int32_t* values, int count);
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * @file cbor.c
+ * @brief Implementacion del codificador CBOR minimo.
+ */
+
+#include <string.h>
+#include "cbor.h"
+
+int cbor_put_head(uint8_t* buf, uint8_t major, uint32_t value)
+{
+    major <<= 5;
+    if(value < 24){
+        buf[0] = major | value;
+        return 1;
+    }else if(value <= 0xff){
+        buf[0] = major | 24;
+        buf[1] = value;
+        return 2;
+    }else if(value <= 0xffff){
+        buf[0] = major | 25;
+        buf[1] = value >> 8;
+        buf[2] = value;
+        return 3;
+    }
+    buf[0] = major | 26;
+    buf[1] = value >> 24;
+    buf[2] = value >> 16;
+    buf[3] = value >> 8;
+    buf[4] = value;
+    return 5;
+}
+
+int cbor_put_int(uint8_t* buf, int32_t value)
+{
+    // Los negativos se codifican como -1 - n
+    if(value < 0) return cbor_put_head(buf, CBOR_MAJOR_NINT, (uint32_t)(-1 - value));
+    return cbor_put_head(buf, CBOR_MAJOR_UINT, (uint32_t)value);
+}
+
+int cbor_put_text(uint8_t* buf, const char* text)
+{
+    uint32_t len = strlen(text);
+    int n = cbor_put_head(buf, CBOR_MAJOR_TEXT, len);
+    memcpy(buf + n, text, len);
+    return n + len;
+}
+
+int cbor_put_fixed(uint8_t* buf, int32_t value, int decimals)
+{
+    int n = 0;
+    if(decimals == 0) return cbor_put_int(buf, value);
+
+    n += cbor_put_head(buf + n, CBOR_MAJOR_TAG, CBOR_TAG_DECIMAL_FRACTION);
+    n += cbor_put_head(buf + n, CBOR_MAJOR_ARRAY, 2);
+    n += cbor_put_int(buf + n, -decimals);
+    n += cbor_put_int(buf + n, value);
+    return n;
+}
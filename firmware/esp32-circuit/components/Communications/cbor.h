@@ -0,0 +1,33 @@
+#ifndef CBOR_H
+#define CBOR_H
+
+/**
+ * @file cbor.h
+ * @brief Codificador CBOR (RFC 8949) minimo para los payloads binarios de telemetria
+ * @details Solo cubre los tipos que publica el modulo de comunicaciones: enteros, textos, mapas y
+ * fracciones decimales (tag 4). Cada funcion escribe en buf y devuelve el numero de bytes escritos;
+ * el llamador reserva espacio suficiente (como maximo 5 bytes de cabecera por elemento).
+ */
+
+#include <stdint.h>
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NINT 1
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_MAJOR_TAG 6
+
+#define CBOR_TAG_DECIMAL_FRACTION 4
+
+int cbor_put_head(uint8_t* buf, uint8_t major, uint32_t value);
+int cbor_put_int(uint8_t* buf, int32_t value);
+int cbor_put_text(uint8_t* buf, const char* text);
+
+/**
+ * @brief Escribe value / 10^decimals como fraccion decimal [-decimals, value] (tag 4).
+ * Con decimals == 0 escribe un entero normal.
+ */
+int cbor_put_fixed(uint8_t* buf, int32_t value, int decimals);
+
+#endif
@@ -3,52 +3,1416 @@
  * @brief Implementacion de logica de comunicacion y publicacion MQTT.
  */
 
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 #include "communications.h"
+#include "cbor.h"
+#include "batch.h"
+#include "template.h"
 
+/**
+ * @brief Topicos del dispositivo: <device>/<id>/<sufijo>
+ */
+typedef enum{
+    TOPIC_ON,
+    TOPIC_SLEEP,
+    TOPIC_CONFIG,
+    TOPIC_DELAY,
+    TOPIC_REPORT,
+    TOPIC_TEMPERATURE,
+    TOPIC_HUMIDICITY,
+    TOPIC_LIGHT,
+    TOPIC_TELEMETRY,
+    TOPIC_UNITS,
+    TOPIC_BACKLOG,
+    TOPIC_BATCH,
+    TOPIC_ERROR,
+    TOPIC_STATUS,
+    TOPIC_DIAG,
+    TOPIC_LINK,
+    TOPIC_BROKER,
+    TOPIC_PING,
+    TOPIC_PONG,
+    TOPIC_COMMANDS,
+    TOPIC_COUNT
+}eComm_topic;
+
+static const char* const gTopicSuffixes[TOPIC_COUNT] = {
+    [TOPIC_ON] = "config/ON",
+    [TOPIC_SLEEP] = "config/SLEEP",
+    [TOPIC_CONFIG] = "config/CONFIG",
+    [TOPIC_DELAY] = "config/DELAY",
+    [TOPIC_REPORT] = "config/REPORT",
+    [TOPIC_TEMPERATURE] = "telemetry/temperature",
+    [TOPIC_HUMIDICITY] = "telemetry/humidicity",
+    [TOPIC_LIGHT] = "telemetry/light",
+    [TOPIC_TELEMETRY] = "telemetry",
+    [TOPIC_UNITS] = "telemetry/units",
+    [TOPIC_BACKLOG] = "telemetry/backlog",
+    [TOPIC_BATCH] = "telemetry/batch",
+    [TOPIC_ERROR] = "error",
+    [TOPIC_STATUS] = "status",
+    [TOPIC_DIAG] = "diag/publish",
+    [TOPIC_LINK] = "diag/link",
+    [TOPIC_BROKER] = "diag/broker",
+    [TOPIC_PING] = "diag/ping",
+    [TOPIC_PONG] = "diag/pong",
+    [TOPIC_COMMANDS] = "config/#", // Unica suscripcion: cubre todos los topicos de comandos
+};
+
+/**
+ * @brief Entrada de la tabla de despacho de los topicos de comandos
+ */
+typedef struct{
+    uint32_t hash;
+    const char* topic; // NULL: hueco libre
+    int len;
+    eComm_message_type message_type;
+    comm_device_t* device;
+}comm_route_t;
+
+typedef enum{
+    FIELD_TEMPERATURE,
+    FIELD_HUMIDICITY,
+    FIELD_LIGHT,
+    FIELD_COUNT
+}eComm_field;
+
+static const template_field_t gFields[FIELD_COUNT] = {
+    [FIELD_TEMPERATURE] = {"temperature", "Celsius", 1},
+    [FIELD_HUMIDICITY] = {"humidicity", "percentage", 1},
+    [FIELD_LIGHT] = {"light", "bool", 0},
+};
+
+// Topico del mensaje por metrica
+static const eComm_topic gFieldTopics[FIELD_COUNT] = {
+    [FIELD_TEMPERATURE] = TOPIC_TEMPERATURE,
+    [FIELD_HUMIDICITY] = TOPIC_HUMIDICITY,
+    [FIELD_LIGHT] = TOPIC_LIGHT,
+};
+
+_Static_assert(FIELD_COUNT <= TEMPLATE_MAX_FIELDS, "El mensaje combinado no cabe en una plantilla");
+_Static_assert(TEMPLATE_LEN <= COMM_TEMPLATE_LEN, "Un payload de plantilla no cabe en un mensaje en cola");
+
+/**
+ * @brief Plantillas de una codificacion: una por metrica y la del mensaje combinado
+ */
+typedef struct{
+    template_t fields[FIELD_COUNT];
+    template_t combined;
+}comm_templates_t;
+
+/**
+ * @brief Muestra guardada mientras no hay conexion
+ */
+typedef struct{
+    int64_t timestamp; // esp_timer_get_time() al recibir la muestra (us)
+    comm_telemetry_t data;
+}comm_sample_t;
+
+/**
+ * @brief Buffer circular de muestras. Si se llena se sobrescribe la mas antigua.
+ * 
+ * seq numera las muestras: la mas antigua del buffer es la seq, asi la tarea de vaciado sabe
+ * cuantas de las que ha publicado siguen en el buffer aunque se hayan sobrescrito entretanto.
+ */
+typedef struct{
+    comm_sample_t samples[COMM_RING_LEN];
+    int head; // Posicion de la muestra mas antigua
+    int count;
+    uint32_t seq;
+    comm_ring_stats_t stats;
+    portMUX_TYPE lock;
+}comm_ring_t;
+
+/**
+ * @brief Publicacion por excepcion: una metrica solo se publica si ha cambiado mas que su banda
+ * muerta desde la ultima vez que se publico, o si lleva heartbeat_ms sin publicarse.
+ * 
+ * Las bandas estan en punto fijo, con los decimales de la metrica (5 = 0.5 C). Una banda negativa
+ * publica todas las muestras y heartbeat_ms == 0 desactiva el heartbeat.
+ */
+typedef struct{
+    int deadband[FIELD_COUNT];
+    int heartbeat_ms;
+}comm_report_t;
+
+/**
+ * @brief Lote de muestras en curso del modo COMM_TELEMETRY_BATCH. Solo lo usa la tarea que publica la
+ * telemetria del dispositivo.
+ */
 typedef struct{
-    char on_topic [MAX_LEN_TOPIC];
-    char sleep_topic [MAX_LEN_TOPIC];
-    char config_topic [MAX_LEN_TOPIC];
-    char delay_topic [MAX_LEN_TOPIC];
-    char temperature_topic [MAX_LEN_TOPIC];
-    char humidicity_topic [MAX_LEN_TOPIC];
-    char light_topic [MAX_LEN_TOPIC]; 
-    char error_topic [MAX_LEN_TOPIC];
-}mqtt_topics_t;
-
-static mqtt_topics_t gTopics;
+    comm_sample_t samples[COMM_BATCH_LEN];
+    int count;
+    // Cabecera (6 varint) y, por metrica, decimales, primer valor y un token por delta
+    uint8_t payload[1 + 6 * 5 + FIELD_COUNT * (2 + COMM_BATCH_LEN) * 5];
+}comm_batch_t;
+
+#define COMM_STATE_LEN 16 // Longitud maxima del nombre del estado en .../status
+#define COMM_WILL_LEN sizeof("{\"id\": -2147483648, \"online\": false}") // Last Will con el id mas largo
+
+/**
+ * @brief Estado de un dispositivo logico. Todo lo que depende de <device>/<id> esta aqui; el cliente,
+ * los carriles y los diagnosticos de la conexion son comunes.
+ */
+struct comm_device{
+    int id;
+    int index; // Posicion en gDevices
+    comm_callback callback;
+    const char* topics[TOPIC_COUNT]; // Apuntan a topic_pool
+    int topic_lens[TOPIC_COUNT];
+    char* topic_pool;
+    comm_templates_t templates[COMM_ENCODING_COUNT];
+    comm_report_t report;
+    int last_values[FIELD_COUNT];
+    int64_t last_published[FIELD_COUNT]; // esp_timer_get_time() de la ultima publicacion
+    int report_started; // 0 hasta la primera muestra: se publica siempre
+    comm_batch_t batch;
+    comm_ring_t ring;
+    char state[COMM_STATE_LEN]; // Ultimo estado de comm_device_send_status(), "" hasta la primera llamada; con gLink.lock
+    int delay;
+};
+
+static comm_device_t gDevices[COMM_MAX_DEVICES];
+static int gDeviceCount;
+static comm_route_t gRoutes[COMM_ROUTES_LEN];
+static eComm_encoding gEncoding = COMM_DEFAULT_ENCODING;
+static eComm_telemetry_mode gTelemetryMode = COMM_DEFAULT_TELEMETRY_MODE;
 static esp_mqtt_client_handle_t client; // client debe ser global para poder publicar desde publish_data()
+/**
+ * @brief Mensaje en cola para publicar
+ */
+typedef struct{
+    comm_device_t* device;
+    eComm_topic topic;
+    uint8_t qos;
+    uint8_t retain;
+    uint16_t len;
+    int64_t queued_at; // esp_timer_get_time() al encolar (us)
+    char payload[COMM_TEMPLATE_LEN];
+}comm_publish_t;
+
+/**
+ * @brief Carriles de publicacion y sus contadores
+ */
+typedef struct{
+    QueueHandle_t lanes[COMM_LANE_COUNT];
+    comm_lane_stats_t stats[COMM_LANE_COUNT];
+    eComm_drop_policy drop_policy;
+    TaskHandle_t task;
+    portMUX_TYPE lock;
+}comm_publisher_t;
+
+static comm_publisher_t gPublisher = {
+    .drop_policy = COMM_DEFAULT_DROP_POLICY,
+    .lock = portMUX_INITIALIZER_UNLOCKED
+};
+/**
+ * @brief Publicacion QoS 1 pendiente de PUBACK
+ */
+typedef struct{
+    int msg_id; // 0: hueco libre
+    int64_t sent_at; // esp_timer_get_time() al entregarla al cliente (us)
+}comm_inflight_t;
+
+/**
+ * @brief Tabla de publicaciones en vuelo y contadores de entrega
+ */
+typedef struct{
+    comm_inflight_t entries[COMM_INFLIGHT_LEN];
+    comm_qos_stats_t stats;
+    int64_t last_diag; // esp_timer_get_time() de la ultima publicacion en .../diag/publish
+    portMUX_TYPE lock;
+}comm_qos_t;
+
+static const uint32_t gLatencyBounds[COMM_LATENCY_BUCKETS - 1] = {10, 25, 50, 100, 250, 500, 1000}; // ms
+
+static comm_qos_t gQos = { .lock = portMUX_INITIALIZER_UNLOCKED };
+static int gTelemetryQos = COMM_DEFAULT_TELEMETRY_QOS;
+static int gBatchSize = COMM_DEFAULT_BATCH_SIZE; // Muestras por lote
+static esp_mqtt_client_config_t gMqttConf;
+
+/**
+ * @brief Tiempo hasta estar listo tras cada conexion
+ */
+typedef struct{
+    int64_t lost_at;  // esp_timer_get_time() al perder la conexion o al arrancar
+    int subscribe_id; // msg_id de la suscripcion pendiente de SUBACK, 0 si no hay
+    comm_link_stats_t stats;
+    portMUX_TYPE lock;
+}comm_link_t;
+
+static comm_link_t gLink = { .lock = portMUX_INITIALIZER_UNLOCKED };
+
+/**
+ * @brief Broker de la lista COMM_BROKER_URIS
+ */
+typedef struct{
+    const char* uri;     // Apunta a gBrokers.pool
+    uint32_t connect_ms; // Media movil del tiempo de conexion, 0 si todavia no se ha medido
+    int64_t failed_at;   // esp_timer_get_time() del ultimo fallo, 0 si no ha fallado
+}comm_broker_t;
+
+/**
+ * @brief Lista de brokers. Solo se usa desde el manejador de eventos MQTT, salvo al arrancar.
+ */
+typedef struct{
+    comm_broker_t list[COMM_MAX_BROKERS];
+    int count;
+    int current;        // Broker de la conexion actual o del intento en curso
+    int lost;           // Broker cuya conexion se perdio, -1 si no hay cambio pendiente
+    int keep;           // 1: el proximo intento repite broker (cambio de version de protocolo)
+    int64_t attempt_at; // MQTT_EVENT_BEFORE_CONNECT del intento en curso
+    char* pool;
+}comm_brokers_t;
+
+static comm_brokers_t gBrokers = { .lost = -1 };
+
+#if COMM_MQTT5
+#define COMM_TOPIC_ALIASES 4 // Alias por dispositivo: el del topico t del dispositivo i es i * 4 + gTopicAliases[t]
+
+/**
+ * @brief Alias MQTT 5 de los topicos de telemetria, que se repiten en cada muestra. 0: sin alias
+ */
+static const uint16_t gTopicAliases[TOPIC_COUNT] = {
+    [TOPIC_TEMPERATURE] = 1,
+    [TOPIC_HUMIDICITY] = 2,
+    [TOPIC_LIGHT] = 3,
+    [TOPIC_TELEMETRY] = 4,
+};
+
+/**
+ * @brief Estado de los alias en la conexion actual.
+ * 
+ * Las propiedades de publicacion de esp-mqtt son del cliente, no de cada mensaje: lock serializa
+ * "fijar alias + publicar + quitar alias" con el resto de publicaciones directas (backlog). Los alias
+ * solo valen en la conexion en la que se anuncian; epoch cuenta las conexiones y la tarea de
+ * publicacion vuelve a negociar y anunciar los alias cuando cambia.
+ */
+typedef struct{
+    int protocol5;           // 0 si el broker ha rechazado MQTT 5 y se ha vuelto a 3.1.1
+    volatile uint32_t epoch; // Se incrementa en cada MQTT_EVENT_CONNECTED
+    uint32_t negotiated;     // epoch de la conexion en la que se han negociado los alias
+    uint16_t max;            // Mayor alias que admite el broker en esta conexion
+    uint8_t announced[COMM_MAX_DEVICES][TOPIC_COUNT]; // El topico completo ya se ha enviado con su alias
+    SemaphoreHandle_t lock;
+}comm_alias_t;
 
-static int id_device;
-static comm_callback callback_private;
+static comm_alias_t gAlias = { .protocol5 = 1 };
+#endif
+static volatile int gConnected = 0;
+static TaskHandle_t gBacklogTask = NULL;
 
 const static char* TAG_MQTT = "MQTT";
-const static char* broker_uri = CONFIG_BROKER_URI;
+const static char* broker_uris = COMM_BROKER_URIS;
 const static char* username = CONFIG_USERNAME;
 const static char* password = CONFIG_PASSWORD;
 
+/**
+ * @brief Encola un mensaje en su carril sin bloquear. Si el carril esta lleno se aplica la politica
+ * de descarte.
+ * @return COMM_ERR_INVALID si el mensaje se ha descartado
+ */
+static eComm_err comm_publish(comm_device_t* device, eComm_lane lane, eComm_topic topic,
+                              const char* payload, int len, int qos, int retain)
+{
+    QueueHandle_t queue = gPublisher.lanes[lane];
+    comm_publish_t message;
+    int dropped = 0;
+    eComm_err err = COMM_OK;
+
+    if(queue == NULL) return COMM_ERR_INVALID;
+
+    if(len > (int) sizeof(message.payload)){
+        ESP_LOGE(TAG_MQTT, "Payload demasiado largo para %s: %d", device->topics[topic], len);
+        dropped = 1;
+        err = COMM_ERR_INVALID;
+    }else{
+        message.device = device;
+        message.topic = topic;
+        message.qos = qos;
+        message.retain = retain;
+        message.len = len;
+        memcpy(message.payload, payload, len);
+        message.queued_at = esp_timer_get_time();
+
+        if(xQueueSend(queue, &message, 0) != pdTRUE){
+            // Carril lleno: se pierde un mensaje, el nuevo o el mas antiguo segun la politica
+            comm_publish_t oldest;
+            dropped = 1;
+            if(gPublisher.drop_policy != COMM_DROP_OLDEST || xQueueReceive(queue, &oldest, 0) != pdTRUE ||
+               xQueueSend(queue, &message, 0) != pdTRUE){
+                err = COMM_ERR_INVALID;
+            }
+        }
+    }
+
+    portENTER_CRITICAL(&gPublisher.lock);
+    gPublisher.stats[lane].dropped += dropped;
+    if(err == COMM_OK) gPublisher.stats[lane].queued++;
+    portEXIT_CRITICAL(&gPublisher.lock);
+
+    if(err == COMM_OK) xTaskNotifyGive(gPublisher.task);
+    return err;
+}
+
+/**
+ * @brief Anota una publicacion QoS 1 en la tabla de publicaciones en vuelo
+ */
+static void comm_inflight_add(int msg_id, int64_t sent_at)
+{
+    if(msg_id <= 0) return; // QoS 0 o el cliente no ha aceptado el mensaje
+
+    portENTER_CRITICAL(&gQos.lock);
+    gQos.stats.sent++;
+    for(int i = 0; i < COMM_INFLIGHT_LEN; i++){
+        if(gQos.entries[i].msg_id == 0){
+            gQos.entries[i].msg_id = msg_id;
+            gQos.entries[i].sent_at = sent_at;
+            gQos.stats.inflight++;
+            portEXIT_CRITICAL(&gQos.lock);
+            return;
+        }
+    }
+    gQos.stats.untracked++;
+    portEXIT_CRITICAL(&gQos.lock);
+}
+
+/**
+ * @brief Cierra una publicacion en vuelo: con su PUBACK (lost = 0) o descartada por el cliente (lost = 1)
+ */
+static void comm_inflight_done(int msg_id, int lost)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&gQos.lock);
+    for(int i = 0; i < COMM_INFLIGHT_LEN; i++){
+        comm_inflight_t* entry = &gQos.entries[i];
+        if(entry->msg_id != msg_id) continue;
+
+        entry->msg_id = 0;
+        gQos.stats.inflight--;
+        if(lost){
+            gQos.stats.lost++;
+        }else{
+            uint32_t latency = (uint32_t)((now - entry->sent_at) / 1000);
+            int bucket = 0;
+            while(bucket < COMM_LATENCY_BUCKETS - 1 && latency >= gLatencyBounds[bucket]) bucket++;
+            gQos.stats.histogram[bucket]++;
+            gQos.stats.acked++;
+            gQos.stats.latency_total_ms += latency;
+            if(latency > gQos.stats.latency_max_ms) gQos.stats.latency_max_ms = latency;
+        }
+        portEXIT_CRITICAL(&gQos.lock);
+        return;
+    }
+    // PUBACK de una publicacion que no se pudo anotar, o que ya se habia dado por perdida
+    if(!lost) gQos.stats.untracked++;
+    portEXIT_CRITICAL(&gQos.lock);
+}
+
+/**
+ * @brief Da por perdidas las publicaciones sin PUBACK desde hace COMM_INFLIGHT_TIMEOUT_MS
+ */
+static void comm_inflight_expire()
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&gQos.lock);
+    for(int i = 0; i < COMM_INFLIGHT_LEN; i++){
+        comm_inflight_t* entry = &gQos.entries[i];
+        if(entry->msg_id != 0 && now - entry->sent_at >= (int64_t)COMM_INFLIGHT_TIMEOUT_MS * 1000){
+            entry->msg_id = 0;
+            gQos.stats.inflight--;
+            gQos.stats.lost++;
+        }
+    }
+    portEXIT_CRITICAL(&gQos.lock);
+}
+
+/**
+ * @brief Publica los contadores de entrega en .../diag/publish del primer dispositivo:
+ * {"id": <id>, "sent": n, "acked": n, "lost": n, "untracked": n, "inflight": n,
+ *  "latency_ms": {"max": n, "avg": n, "bounds": [10, ...], "histogram": [n, ...]}}
+ * 
+ * histogram[i] cuenta los PUBACK con latencia < bounds[i]; el ultimo, los de bounds[ultimo] o mas.
+ */
+static void comm_send_diag()
+{
+    char buffer[320];
+    struct json_out out = JSON_OUT_BUF(buffer, sizeof(buffer));
+    comm_qos_stats_t stats;
+    int len;
+
+    comm_get_qos_stats(&stats);
+
+    len = json_printf(&out, "{id: %d, sent: %u, acked: %u, lost: %u, untracked: %u, inflight: %u, ",
+                      gDevices[0].id, (unsigned) stats.sent, (unsigned) stats.acked, (unsigned) stats.lost,
+                      (unsigned) stats.untracked, (unsigned) stats.inflight);
+    len += json_printf(&out, "latency_ms: {max: %u, avg: %u, bounds: [", (unsigned) stats.latency_max_ms,
+                       (unsigned)(stats.acked > 0 ? stats.latency_total_ms / stats.acked : 0));
+    for(int i = 0; i < COMM_LATENCY_BUCKETS - 1; i++){
+        len += json_printf(&out, i > 0 ? ", %u" : "%u", (unsigned) gLatencyBounds[i]);
+    }
+    len += json_printf(&out, "], histogram: [");
+    for(int i = 0; i < COMM_LATENCY_BUCKETS; i++){
+        len += json_printf(&out, i > 0 ? ", %u" : "%u", (unsigned) stats.histogram[i]);
+    }
+    len += json_printf(&out, "]}}");
+
+    if(len < (int) sizeof(buffer)){
+        esp_mqtt_client_enqueue(client, gDevices[0].topics[TOPIC_DIAG], buffer, len, 0, 0, true);
+    }
+}
+
+#if COMM_MQTT5
+/**
+ * @brief Comprueba cuantos alias admite el broker en la conexion actual
+ * @details esp-mqtt no expone el Topic Alias Maximum del CONNACK, pero rechaza fijar un alias mayor.
+ * Se llama desde la tarea de publicacion con gAlias.lock tomado.
+ */
+static void comm_alias_negotiate()
+{
+    esp_mqtt5_publish_property_config_t property = {0};
+
+    gAlias.max = 0;
+    for(int alias = 1; alias <= gDeviceCount * COMM_TOPIC_ALIASES; alias++){
+        property.topic_alias = alias;
+        if(esp_mqtt5_client_set_publish_property(client, &property) != ESP_OK) break;
+        gAlias.max = alias;
+    }
+    property.topic_alias = 0;
+    esp_mqtt5_client_set_publish_property(client, &property);
+
+    memset(gAlias.announced, 0, sizeof(gAlias.announced));
+    gAlias.negotiated = gAlias.epoch;
+    ESP_LOGI(TAG_MQTT, "Alias de topico disponibles: %d", gAlias.max);
+}
+
+/**
+ * @brief Publica un mensaje de telemetria con su alias de topico: la primera vez en la conexion con el
+ * topico completo y despues con el topico vacio.
+ * @return 0 si el mensaje no puede usar alias y hay que publicarlo normalmente
+ * 
+ * Solo se usa con QoS 0 y esp_mqtt_client_publish(), que escribe directamente en el socket sin pasar
+ * por el outbox: un mensaje con el topico vacio que se reenviase en otra conexion, donde el alias ya
+ * no existe, seria un error de protocolo y el broker cerraria la conexion.
+ */
+static int comm_alias_publish(const comm_publish_t* message, int* msg_id)
+{
+    comm_device_t* device = message->device;
+    uint16_t alias = gTopicAliases[message->topic];
+    esp_mqtt5_publish_property_config_t property = {0};
+
+    if(!gAlias.protocol5 || alias == 0 || message->qos > 0 || !gConnected) return 0;
+    alias += device->index * COMM_TOPIC_ALIASES;
+
+    xSemaphoreTake(gAlias.lock, portMAX_DELAY);
+    if(gAlias.negotiated != gAlias.epoch) comm_alias_negotiate();
+    if(alias > gAlias.max){
+        xSemaphoreGive(gAlias.lock);
+        return 0;
+    }
+
+    property.topic_alias = alias;
+    esp_mqtt5_client_set_publish_property(client, &property);
+    *msg_id = esp_mqtt_client_publish(client, gAlias.announced[device->index][message->topic] ? "" :
+                                      device->topics[message->topic], message->payload, message->len, 0,
+                                      message->retain);
+    property.topic_alias = 0;
+    esp_mqtt5_client_set_publish_property(client, &property);
+    if(*msg_id >= 0) gAlias.announced[device->index][message->topic] = 1;
+    xSemaphoreGive(gAlias.lock);
+    return 1;
+}
+#endif
+
+/**
+ * @brief Separa COMM_BROKER_URIS en gBrokers.list
+ * @return Numero de brokers, 0 si no hay memoria o la lista esta vacia
+ */
+static int comm_brokers_init()
+{
+    char* uri;
+
+    // Se reserva una sola vez, en el arranque, y no se libera nunca
+    gBrokers.pool = malloc(strlen(broker_uris) + 1);
+    if(gBrokers.pool == NULL) return 0;
+    strcpy(gBrokers.pool, broker_uris);
+
+    uri = gBrokers.pool;
+    while(uri != NULL && gBrokers.count < COMM_MAX_BROKERS){
+        char* next = strchr(uri, ',');
+        if(next != NULL) *next++ = '\0';
+        while(*uri == ' ') uri++;
+        if(*uri != '\0'){
+            gBrokers.list[gBrokers.count++].uri = uri;
+            ESP_LOGI(TAG_MQTT, "Broker %d: %s", gBrokers.count - 1, uri);
+        }
+        uri = next;
+    }
+    return gBrokers.count;
+}
+
+/**
+ * @brief Elige el broker del proximo intento: el de menor tiempo de conexion de los que no han fallado
+ * en COMM_BROKER_RETRY_MS. Si han fallado todos, el que lleva mas tiempo sin fallar.
+ */
+static int comm_broker_select(int64_t now)
+{
+    int best = -1;
+
+    for(int i = 0; i < gBrokers.count; i++){
+        const comm_broker_t* broker = &gBrokers.list[i];
+        if(broker->failed_at != 0 && now - broker->failed_at < (int64_t)COMM_BROKER_RETRY_MS * 1000) continue;
+        if(best < 0 || broker->connect_ms < gBrokers.list[best].connect_ms) best = i;
+    }
+    if(best >= 0) return best;
+
+    best = 0;
+    for(int i = 1; i < gBrokers.count; i++){
+        if(gBrokers.list[i].failed_at < gBrokers.list[best].failed_at) best = i;
+    }
+    return best;
+}
+
+/**
+ * @brief MQTT_EVENT_DISCONNECTED: marca el broker actual como caido y pasa el cliente al siguiente.
+ * El cliente reconecta solo, COMM_RECONNECT_MS despues, con la nueva URI.
+ * @param was_connected 1 si se ha perdido una conexion establecida, 0 si ha fallado un intento
+ */
+static void comm_broker_failed(int was_connected)
+{
+    int64_t now = esp_timer_get_time();
+    int next;
+
+    if(gBrokers.count <= 1) return;
+    if(gBrokers.keep){
+        gBrokers.keep = 0;
+        return;
+    }
+
+    gBrokers.list[gBrokers.current].failed_at = now;
+    if(was_connected) gBrokers.lost = gBrokers.current;
+
+    next = comm_broker_select(now);
+    if(next != gBrokers.current){
+        gBrokers.current = next;
+        gMqttConf.broker.address.uri = gBrokers.list[next].uri; // Por si se vuelve a aplicar la configuracion
+        esp_mqtt_client_set_uri(client, gBrokers.list[next].uri);
+        ESP_LOGW(TAG_MQTT, "Cambio al broker %d: %s", next, gBrokers.list[next].uri);
+    }
+}
+
+/**
+ * @brief MQTT_EVENT_CONNECTED: anota el tiempo de conexion del broker y, si viene de perder otro broker,
+ * el tiempo del cambio. Lo publica en .../diag/broker:
+ * {"id": <id>, "broker": n, "connect_ms": n, "failovers": n, "failover_ms": n, "failover_max_ms": n}
+ */
+static void comm_broker_connected()
+{
+    char buffer[COMM_TEMPLATE_LEN];
+    struct json_out out = JSON_OUT_BUF(buffer, sizeof(buffer));
+    int64_t now = esp_timer_get_time();
+    comm_broker_t* broker = &gBrokers.list[gBrokers.current];
+    uint32_t connect_ms = (uint32_t)((now - gBrokers.attempt_at) / 1000);
+    comm_link_stats_t stats;
+    int len;
+
+    broker->connect_ms = broker->connect_ms == 0 ? connect_ms : (3 * broker->connect_ms + connect_ms) / 4;
+    broker->failed_at = 0;
+
+    portENTER_CRITICAL(&gLink.lock);
+    gLink.stats.broker = gBrokers.current;
+    gLink.stats.connect_ms = connect_ms;
+    if(gBrokers.lost >= 0 && gBrokers.lost != gBrokers.current){
+        gLink.stats.failovers++;
+        gLink.stats.failover_ms = (uint32_t)((now - gLink.lost_at) / 1000);
+        if(gLink.stats.failover_ms > gLink.stats.failover_max_ms) gLink.stats.failover_max_ms = gLink.stats.failover_ms;
+    }
+    stats = gLink.stats;
+    portEXIT_CRITICAL(&gLink.lock);
+    gBrokers.lost = -1;
+
+    ESP_LOGI(TAG_MQTT, "Conectado al broker %d en %u ms", gBrokers.current, (unsigned) connect_ms);
+    len = json_printf(&out, "{id: %d, broker: %u, connect_ms: %u, failovers: %u, failover_ms: %u, failover_max_ms: %u}",
+                      gDevices[0].id, (unsigned) stats.broker, (unsigned) stats.connect_ms,
+                      (unsigned) stats.failovers, (unsigned) stats.failover_ms, (unsigned) stats.failover_max_ms);
+    if(len < (int) sizeof(buffer)) comm_publish(&gDevices[0], COMM_LANE_PRIORITY, TOPIC_BROKER, buffer, len, 0, 0);
+}
+
+/**
+ * @brief Anota el tiempo hasta estar listo y lo publica en .../diag/link:
+ * {"id": <id>, "connects": n, "ready_ms": n, "ready_max_ms": n}
+ */
+static void comm_link_ready()
+{
+    char buffer[COMM_TEMPLATE_LEN];
+    struct json_out out = JSON_OUT_BUF(buffer, sizeof(buffer));
+    comm_link_stats_t stats;
+    int len;
+
+    portENTER_CRITICAL(&gLink.lock);
+    gLink.subscribe_id = 0;
+    gLink.stats.connects++;
+    gLink.stats.ready_ms = (uint32_t)((esp_timer_get_time() - gLink.lost_at) / 1000);
+    if(gLink.stats.ready_ms > gLink.stats.ready_max_ms) gLink.stats.ready_max_ms = gLink.stats.ready_ms;
+    stats = gLink.stats;
+    portEXIT_CRITICAL(&gLink.lock);
+
+    ESP_LOGI(TAG_MQTT, "Listo en %u ms", (unsigned) stats.ready_ms);
+    len = json_printf(&out, "{id: %d, connects: %u, ready_ms: %u, ready_max_ms: %u}", gDevices[0].id,
+                      (unsigned) stats.connects, (unsigned) stats.ready_ms, (unsigned) stats.ready_max_ms);
+    if(len < (int) sizeof(buffer)) comm_publish(&gDevices[0], COMM_LANE_PRIORITY, TOPIC_LINK, buffer, len, 0, 0);
+}
+
+/**
+ * @brief Entrega un mensaje al cliente MQTT y actualiza los contadores de su carril
+ */
+static void comm_publish_message(eComm_lane lane, const comm_publish_t* message)
+{
+    int64_t sent_at = esp_timer_get_time();
+    int msg_id;
+
+#if COMM_MQTT5
+    if(!comm_alias_publish(message, &msg_id))
+#endif
+    msg_id = esp_mqtt_client_enqueue(client, message->device->topics[message->topic], message->payload,
+                                     message->len, message->qos, message->retain, true);
+    if(message->qos > 0) comm_inflight_add(msg_id, sent_at);
+
+    uint32_t latency = (uint32_t)(esp_timer_get_time() - message->queued_at);
+    portENTER_CRITICAL(&gPublisher.lock);
+    comm_lane_stats_t* stats = &gPublisher.stats[lane];
+    stats->published++;
+    stats->latency_total_us += latency;
+    if(latency > stats->latency_max_us) stats->latency_max_us = latency;
+    portEXIT_CRITICAL(&gPublisher.lock);
+}
+
+/**
+ * @brief Tarea de publicacion: vacia los carriles, siempre el prioritario antes que el de telemetria
+ * @details esp_mqtt_client_enqueue() no espera al socket, pero si al cerrojo del cliente, que la tarea
+ * MQTT mantiene mientras escribe. Por eso las tareas que generan mensajes solo encolan y es esta
+ * tarea la que espera, de forma que el muestreo no depende del estado de la red.
+ */
+static void vCommPublishTask(void* pvParameters)
+{
+    comm_publish_t message;
+
+    for(;;){
+        /*
+            Ademas de con cada mensaje, la tarea se despierta periodicamente para dar por perdidas las
+            publicaciones QoS 1 sin PUBACK y publicar las metricas de entrega.
+        */
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(COMM_INFLIGHT_TIMEOUT_MS / 2));
+
+        comm_inflight_expire();
+        if(gTelemetryQos > 0 && gConnected &&
+           esp_timer_get_time() - gQos.last_diag >= (int64_t)COMM_DIAG_PERIOD_MS * 1000){
+            gQos.last_diag = esp_timer_get_time();
+            comm_send_diag();
+        }
+
+        for(;;){
+            if(xQueueReceive(gPublisher.lanes[COMM_LANE_PRIORITY], &message, 0) == pdTRUE){
+                comm_publish_message(COMM_LANE_PRIORITY, &message);
+            }else if(xQueueReceive(gPublisher.lanes[COMM_LANE_BULK], &message, 0) == pdTRUE){
+                comm_publish_message(COMM_LANE_BULK, &message);
+            }else{
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Publica las unidades de las metricas del mensaje combinado, retenido para que las reciba
+ * cualquier consumidor que se suscriba despues: {"temperature": "Celsius", ...}
+ */
+static void comm_send_units(comm_device_t* device)
+{
+    char buffer[COMM_TEMPLATE_LEN];
+    struct json_out out = JSON_OUT_BUF(buffer, sizeof(buffer));
+    int len = json_printf(&out, "{");
+
+    for(int i = 0; i < FIELD_COUNT; i++){
+        len += json_printf(&out, i > 0 ? ", %Q: %Q" : "%Q: %Q", gFields[i].key, gFields[i].unit);
+    }
+    len += json_printf(&out, "}");
+
+    if(len < (int) sizeof(buffer)){
+        comm_publish(device, COMM_LANE_PRIORITY, TOPIC_UNITS, buffer, len, 1, 1);
+    }
+}
+
+/**
+ * @brief Pasa una muestra a punto fijo, en el orden de gFields
+ */
+static void comm_telemetry_values(const comm_telemetry_t* data, int* values)
+{
+    values[FIELD_TEMPERATURE] = data->temperature * 10 + data->temperature_dec;
+    values[FIELD_HUMIDICITY] = data->humicity * 10 + data->humicity_dec;
+    values[FIELD_LIGHT] = data->light;
+}
+
+/**
+ * @brief Guarda una muestra en el buffer circular, sobrescribiendo la mas antigua si esta lleno
+ */
+static void comm_ring_push_sample(comm_ring_t* ring, const comm_sample_t* sample)
+{
+    portENTER_CRITICAL(&ring->lock);
+    if(ring->count == COMM_RING_LEN){
+        ring->head = (ring->head + 1) % COMM_RING_LEN;
+        ring->count--;
+        ring->seq++;
+        ring->stats.overflows++;
+    }
+    ring->samples[(ring->head + ring->count) % COMM_RING_LEN] = *sample;
+    ring->count++;
+    ring->stats.buffered++;
+    portEXIT_CRITICAL(&ring->lock);
+}
+
+/**
+ * @brief Guarda en el buffer circular una muestra tomada ahora
+ */
+static void comm_ring_push(comm_ring_t* ring, const comm_telemetry_t* data)
+{
+    comm_sample_t sample = { .timestamp = esp_timer_get_time(), .data = *data };
+    comm_ring_push_sample(ring, &sample);
+}
+
+/**
+ * @brief Copia hasta max muestras, las mas antiguas, sin sacarlas del buffer
+ * @return Numero de muestras copiadas. En seq se devuelve el numero de la primera.
+ */
+static int comm_ring_peek(comm_ring_t* ring, comm_sample_t* samples, int max, uint32_t* seq)
+{
+    portENTER_CRITICAL(&ring->lock);
+    int n = ring->count < max ? ring->count : max;
+    for(int i = 0; i < n; i++){
+        samples[i] = ring->samples[(ring->head + i) % COMM_RING_LEN];
+    }
+    *seq = ring->seq;
+    portEXIT_CRITICAL(&ring->lock);
+    return n;
+}
+
+/**
+ * @brief Saca del buffer las n muestras publicadas a partir de seq (las que no se hayan sobrescrito ya)
+ */
+static void comm_ring_drop(comm_ring_t* ring, uint32_t seq, int n)
+{
+    portENTER_CRITICAL(&ring->lock);
+    int drop = (int)(seq + n - ring->seq);
+    if(drop > ring->count) drop = ring->count;
+    if(drop > 0){
+        ring->head = (ring->head + drop) % COMM_RING_LEN;
+        ring->count -= drop;
+        ring->seq += drop;
+        ring->stats.replayed += drop; // Las sobrescritas mientras se publicaba ya cuentan como overflows
+    }
+    portEXIT_CRITICAL(&ring->lock);
+}
+
+/**
+ * @brief Publica un lote de muestras del buffer:
+ * {"id": <id>, "samples": [{"age_ms": <ms>, "temperature": <valor>, ...}, ...]}
+ * 
+ * age_ms es la antiguedad de la muestra al publicarla; el consumidor obtiene la hora de la muestra
+ * restandosela a la hora de recepcion, sin necesitar reloj de tiempo real en el ESP32.
+ * @return msg_id de la publicacion, -1 si no se ha podido publicar
+ */
+static int comm_send_backlog(comm_device_t* device, const comm_sample_t* samples, int n)
+{
+    static char buffer[COMM_RING_BATCH * COMM_TEMPLATE_LEN];
+    struct json_out out = JSON_OUT_BUF(buffer, sizeof(buffer));
+    int64_t now = esp_timer_get_time();
+    int values[FIELD_COUNT];
+    char number[24];
+    int len;
+
+    len = json_printf(&out, "{id: %d, samples: [", device->id);
+    for(int i = 0; i < n; i++){
+        len += json_printf(&out, i > 0 ? ", {age_ms: %lld" : "{age_ms: %lld",
+                           (long long)((now - samples[i].timestamp) / 1000));
+        comm_telemetry_values(&samples[i].data, values);
+        for(int field = 0; field < FIELD_COUNT; field++){
+            json_format_fixed(number, values[field], gFields[field].decimals);
+            len += json_printf(&out, ", %Q: %s", gFields[field].key, number);
+        }
+        len += json_printf(&out, "}");
+    }
+    len += json_printf(&out, "]}");
+
+    if(len >= (int) sizeof(buffer)) return -1;
+
+    int64_t sent_at = esp_timer_get_time();
+#if COMM_MQTT5
+    xSemaphoreTake(gAlias.lock, portMAX_DELAY); // Que no se publique con el alias de otro topico
+#endif
+    int msg_id = esp_mqtt_client_publish(client, device->topics[TOPIC_BACKLOG], buffer, len, 1, 0);
+#if COMM_MQTT5
+    xSemaphoreGive(gAlias.lock);
+#endif
+    comm_inflight_add(msg_id, sent_at);
+    return msg_id;
+}
+
+/**
+ * @brief Tarea que vacia el buffer de muestras al reconectar
+ * @details Se despierta con MQTT_EVENT_CONNECTED y publica lotes de COMM_RING_BATCH muestras cada
+ * COMM_RING_PERIOD_MS para no saturar el enlace ni retrasar la telemetria en vivo, que se sigue
+ * publicando directamente desde comm_send_telemetry(). Si se vuelve a perder la conexion, las
+ * muestras que quedan esperan a la siguiente reconexion. Los dispositivos se vacian por turnos.
+ * Si un lote no se puede publicar (p. ej. con el outbox lleno) se reintenta con una pausa que se
+ * duplica cada vez; tras COMM_RING_RETRIES fallos seguidos se espera a la siguiente reconexion.
+ */
+static void vCommBacklogTask(void* pvParameters)
+{
+    comm_sample_t samples[COMM_RING_BATCH];
+    uint32_t seq;
+    int n, failures;
+
+    for(;;){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        failures = 0;
+        for(int pending = 1; pending && gConnected;){
+            pending = 0;
+            for(int i = 0; i < gDeviceCount && gConnected; i++){
+                comm_device_t* device = &gDevices[i];
+                if((n = comm_ring_peek(&device->ring, samples, COMM_RING_BATCH, &seq)) == 0) continue;
+                if(comm_send_backlog(device, samples, n) < 0){
+                    if(failures < COMM_RING_RETRIES){
+                        failures++;
+                        pending = 1;
+                        vTaskDelay(pdMS_TO_TICKS(COMM_RING_PERIOD_MS << failures));
+                    }
+                    continue;
+                }
+                failures = 0;
+                comm_ring_drop(&device->ring, seq, n);
+                pending = 1;
+                vTaskDelay(pdMS_TO_TICKS(COMM_RING_PERIOD_MS));
+            }
+        }
+    }
+}
+
+/**
+ * @brief Codifica las n primeras muestras del lote:
+ * 
+ * version (1 byte), uvarint id, uvarint age_ms, uvarint period_ms, uvarint muestras, uvarint metricas
+ * y una serie por metrica en el orden de gFields (ver batch_put_series()).
+ * 
+ * age_ms es la antiguedad de la primera muestra al publicar y period_ms el periodo medio, de forma que
+ * la muestra i se tomo age_ms - i * period_ms antes de la recepcion.
+ * @return Longitud del payload
+ */
+static int comm_batch_encode(comm_device_t* device, uint8_t* buf, int n)
+{
+    const comm_sample_t* samples = device->batch.samples;
+    int32_t series[COMM_BATCH_LEN];
+    int values[FIELD_COUNT];
+    int64_t now = esp_timer_get_time();
+    int64_t first = samples[0].timestamp;
+    int len = 0;
+
+    buf[len++] = BATCH_VERSION;
+    len += batch_put_uvarint(buf + len, device->id);
+    len += batch_put_uvarint(buf + len, (uint32_t)((now - first) / 1000));
+    len += batch_put_uvarint(buf + len, n > 1 ? (uint32_t)((samples[n - 1].timestamp - first) / 1000 / (n - 1)) : 0);
+    len += batch_put_uvarint(buf + len, n);
+    len += batch_put_uvarint(buf + len, FIELD_COUNT);
+
+    for(int field = 0; field < FIELD_COUNT; field++){
+        for(int i = 0; i < n; i++){
+            comm_telemetry_values(&samples[i].data, values);
+            series[i] = values[field];
+        }
+        len += batch_put_series(buf + len, gFields[field].decimals, series, n);
+    }
+    return len;
+}
+
+/**
+ * @brief Publica las n primeras muestras del lote y deja las demas al principio
+ */
+static void comm_batch_flush(comm_device_t* device, int n)
+{
+    comm_batch_t* batch = &device->batch;
+    int len;
+
+    if(n == 0) return;
+
+    len = comm_batch_encode(device, batch->payload, n);
+    comm_publish(device, COMM_LANE_BULK, TOPIC_BATCH, (const char*)batch->payload, len, gTelemetryQos, 0);
+
+    batch->count -= n;
+    memmove(batch->samples, batch->samples + n, batch->count * sizeof(comm_sample_t));
+}
+
+/**
+ * @brief Añade una muestra al lote y lo publica cuando esta completo
+ * @details El lote se publica antes de tiempo si el periodo de muestreo cambia (la serie supone un
+ * periodo fijo) o si con la nueva muestra dejaria de caber en un mensaje. Sin conexion las muestras
+ * pasan al buffer circular, igual que en el resto de modos.
+ */
+static void comm_batch_push(comm_device_t* device, const comm_telemetry_t* data)
+{
+    comm_batch_t* batch = &device->batch;
+    comm_sample_t* samples = batch->samples;
+    int64_t now = esp_timer_get_time();
+
+    if(!gConnected){
+        for(int i = 0; i < batch->count; i++){
+            comm_ring_push_sample(&device->ring, &samples[i]);
+        }
+        batch->count = 0;
+        comm_ring_push(&device->ring, data);
+        return;
+    }
+
+    // Variacion de mas de un 25% sobre el periodo del lote: se cierra el lote
+    if(batch->count >= 2){
+        int64_t period = samples[1].timestamp - samples[0].timestamp;
+        int64_t interval = now - samples[batch->count - 1].timestamp;
+        if(interval > period + period / 4 || interval < period - period / 4){
+            comm_batch_flush(device, batch->count);
+        }
+    }
+
+    samples[batch->count].timestamp = now;
+    samples[batch->count].data = *data;
+    batch->count++;
+
+    /*
+        Se codifica el lote completo con cada muestra (como mucho COMM_BATCH_LEN por metrica) para
+        saber si sigue cabiendo en un mensaje. Si no, se publica sin la ultima muestra.
+    */
+    if(batch->count > 1 && comm_batch_encode(device, batch->payload, batch->count) > COMM_TEMPLATE_LEN){
+        comm_batch_flush(device, batch->count - 1);
+    }
+    if(batch->count >= gBatchSize){
+        comm_batch_flush(device, batch->count);
+    }
+}
+
+/**
+ * @brief Marca en due las metricas que hay que publicar y devuelve cuantas son
+ */
+static int comm_report_due(comm_device_t* device, const int* values, int* due)
+{
+    const comm_report_t* report = &device->report;
+    int64_t now = esp_timer_get_time();
+    int count = 0;
+
+    for(int field = 0; field < FIELD_COUNT; field++){
+        int change = abs(values[field] - device->last_values[field]);
+        due[field] = !device->report_started || report->deadband[field] < 0 ||
+                     change > report->deadband[field] ||
+                     (report->heartbeat_ms > 0 &&
+                      now - device->last_published[field] >= (int64_t)report->heartbeat_ms * 1000);
+        if(due[field]){
+            device->last_values[field] = values[field];
+            device->last_published[field] = now;
+            count++;
+        }
+    }
+    device->report_started = 1;
+    return count;
+}
+
+/**
+ * @brief Convierte un numero JSON ("0.5", "-1", "2") a punto fijo con decimals decimales
+ * @return COMM_ERR_INVALID si no es un numero decimal simple
+ */
+static eComm_err comm_parse_fixed(const char* str, int len, int decimals, int* value)
+{
+    int i = 0, negative = 0, digits = 0, frac = -1;
+    int result = 0;
+
+    if(i < len && str[i] == '-'){
+        negative = 1;
+        i++;
+    }
+    for(; i < len; i++){
+        if(str[i] == '.' && frac < 0){
+            frac = 0;
+        }else if(str[i] >= '0' && str[i] <= '9'){
+            if(frac >= decimals) continue; // Decimales de mas: se truncan
+            if(result > 100000000) return COMM_ERR_INVALID;
+            result = result * 10 + (str[i] - '0');
+            digits++;
+            if(frac >= 0) frac++;
+        }else{
+            return COMM_ERR_INVALID;
+        }
+    }
+    if(digits == 0) return COMM_ERR_INVALID;
+    for(frac = frac < 0 ? 0 : frac; frac < decimals; frac++){
+        if(result > 100000000) return COMM_ERR_INVALID;
+        result *= 10;
+    }
+
+    *value = negative ? -result : result;
+    return COMM_OK;
+}
+
+#define COMM_PING_NONCE_LEN 32 // Longitud maxima del nonce de diag/ping
+
+/**
+ * @brief Estado del mensaje recibido en curso, que puede llegar fragmentado
+ */
+typedef struct{
+    int active;
+    int value_found;
+    comm_device_t* device;
+    comm_message_t message;
+    comm_report_t report; // REPORT: configuracion recibida, se aplica si el payload es valido
+    int report_invalid;
+    char nonce[COMM_PING_NONCE_LEN]; // PING: nonce tal y como llega en el payload, sin comillas
+    int nonce_len;
+    int nonce_string;
+    struct json_stream stream;
+}comm_pending_t;
+
+static comm_pending_t gPending;
+
+/**
+ * @brief Responde a un diag/ping en .../diag/pong: {"id": <id>, "nonce": <nonce>, "rx_us": n, "tx_us": n}
+ * @details rx_us es cuando el ping llega al manejador MQTT y tx_us cuando se entrega el pong al cliente,
+ * ambos en el reloj del dispositivo (us desde el arranque). tx_us - rx_us es el tiempo en el dispositivo;
+ * el resto del RTT medido por quien envia el ping es red y broker.
+ * 
+ * Se publica directamente desde el manejador de eventos, sin pasar por la FSM ni por los carriles, con
+ * QoS 0. Con MQTT 5, si otra tarea esta publicando con alias en ese momento, el pong no puede usar el
+ * cliente sin riesgo de llevarse su alias y se encola en el carril prioritario; su espera en el carril
+ * se contara entonces como red.
+ */
+static void comm_send_pong(const comm_pending_t* ping)
+{
+    char buffer[COMM_TEMPLATE_LEN];
+    struct json_out out = JSON_OUT_BUF(buffer, sizeof(buffer));
+    int len;
+
+    len = json_printf(&out, "{id: %d", ping->message.id);
+    if(ping->value_found){
+        len += json_printf(&out, ping->nonce_string ? ", nonce: \"%.*s\"" : ", nonce: %.*s",
+                           ping->nonce_len, ping->nonce);
+    }
+    len += json_printf(&out, ", rx_us: %lld, tx_us: %lld}", (long long) ping->message.received_us,
+                       (long long) esp_timer_get_time());
+    if(len >= (int) sizeof(buffer)) return;
+
+#if COMM_MQTT5
+    if(xSemaphoreTake(gAlias.lock, 0) != pdTRUE){
+        comm_publish(ping->device, COMM_LANE_PRIORITY, TOPIC_PONG, buffer, len, 0, 0);
+        return;
+    }
+#endif
+    esp_mqtt_client_publish(client, ping->device->topics[TOPIC_PONG], buffer, len, 0, 0);
+#if COMM_MQTT5
+    xSemaphoreGive(gAlias.lock);
+#endif
+}
+
+/**
+ * @brief Callback del parser en streaming: recoge los valores del payload
+ */
+static void comm_stream_cb(void *callback_data, const char *name, size_t name_len,
+                           const char *path, const struct json_token *token)
+{
+    comm_pending_t* pending = callback_data;
+    char buffer[16];
+
+    if(pending->message.message_type == PING){
+        // {nonce: "..."} o {nonce: n}: se devuelve tal cual en el pong
+        if(strcmp(path, ".nonce") == 0 && token->ptr != NULL && token->len <= COMM_PING_NONCE_LEN &&
+           (token->type == JSON_TYPE_STRING || token->type == JSON_TYPE_NUMBER)){
+            memcpy(pending->nonce, token->ptr, token->len);
+            pending->nonce_len = token->len;
+            pending->nonce_string = token->type == JSON_TYPE_STRING;
+            pending->value_found = 1;
+        }
+        return;
+    }
+
+    if(token->type != JSON_TYPE_NUMBER) return;
+
+    if(pending->message.message_type == DELAY){
+        if(strcmp(path, ".delay") == 0 && token->len < (int) sizeof(buffer)){
+            char* end;
+            long delay;
+            memcpy(buffer, token->ptr, token->len);
+            buffer[token->len] = '\0';
+            // Solo un entero decimal no negativo: "5e3", "0x10", "2.5" o "-1" no son un retardo
+            errno = 0;
+            delay = strtol(buffer, &end, 10);
+            if(*end == '\0' && errno == 0 && delay >= 0 && delay <= INT_MAX){
+                pending->message.value = (int) delay;
+                pending->value_found = 1;
+            }
+        }
+    }else if(pending->message.message_type == REPORT){
+        /*
+            {
+                heartbeat: ms,
+                deadband: {temperature: 0.5, humidicity: 1, light: 0}
+            }
+            Los campos que no aparecen conservan su valor actual.
+        */
+        if(strcmp(path, ".heartbeat") == 0){
+            if(comm_parse_fixed(token->ptr, token->len, 0, &pending->report.heartbeat_ms) != COMM_OK ||
+               pending->report.heartbeat_ms < 0){
+                pending->report_invalid = 1;
+            }
+            pending->value_found = 1;
+        }else if(strncmp(path, ".deadband.", 10) == 0){
+            for(int field = 0; field < FIELD_COUNT; field++){
+                if(strcmp(path + 10, gFields[field].key) == 0){
+                    if(comm_parse_fixed(token->ptr, token->len, gFields[field].decimals,
+                                        &pending->report.deadband[field]) != COMM_OK){
+                        pending->report_invalid = 1;
+                    }
+                    pending->value_found = 1;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Hash FNV-1a de un topico
+ */
+static uint32_t comm_topic_hash(const char* topic, int len)
+{
+    uint32_t hash = 2166136261u;
+    for(int i = 0; i < len; i++){
+        hash = (hash ^ (uint8_t)topic[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Registra un topico de comandos en la tabla de despacho (direccionamiento abierto)
+ */
+static void comm_route_add(comm_device_t* device, eComm_topic topic, eComm_message_type message_type)
+{
+    uint32_t hash = comm_topic_hash(device->topics[topic], device->topic_lens[topic]);
+
+    for(int i = 0; i < COMM_ROUTES_LEN; i++){
+        comm_route_t* route = &gRoutes[(hash + i) % COMM_ROUTES_LEN];
+        if(route->topic == NULL){
+            route->hash = hash;
+            route->topic = device->topics[topic];
+            route->len = device->topic_lens[topic];
+            route->message_type = message_type;
+            route->device = device;
+            return;
+        }
+    }
+    ESP_LOGE(TAG_MQTT, "Tabla de topicos llena: %s", device->topics[topic]);
+}
+
+/**
+ * @brief Busca el topico recibido (no terminado en '\0') en la tabla de despacho
+ * @return Entrada del topico o NULL si no es un topico de comandos
+ */
+static const comm_route_t* comm_route_find(const char* topic, int len)
+{
+    uint32_t hash = comm_topic_hash(topic, len);
+
+    for(int i = 0; i < COMM_ROUTES_LEN; i++){
+        const comm_route_t* route = &gRoutes[(hash + i) % COMM_ROUTES_LEN];
+        if(route->topic == NULL) return NULL;
+        if(route->hash == hash && route->len == len && memcmp(route->topic, topic, len) == 0){
+            return route;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Genera todos los topicos del dispositivo en un unico bloque de memoria del tamaño justo
+ * @return COMM_ERR_INVALID si no hay memoria o algun topico supera MAX_LEN_TOPIC
+ */
+static eComm_err comm_topics_init(comm_device_t* device, const char* name, int id)
+{
+    int* lens = device->topic_lens;
+    int size = 0;
+    for(int topic = 0; topic < TOPIC_COUNT; topic++){
+        lens[topic] = snprintf(NULL, 0, "%s/%d/%s", name, id, gTopicSuffixes[topic]);
+        if(lens[topic] >= MAX_LEN_TOPIC) return COMM_ERR_INVALID;
+        size += lens[topic] + 1;
+    }
+
+    // Se reserva una sola vez, en el arranque, y no se libera nunca
+    device->topic_pool = malloc(size);
+    if(device->topic_pool == NULL) return COMM_ERR_INVALID;
+
+    char* p = device->topic_pool;
+    for(int topic = 0; topic < TOPIC_COUNT; topic++){
+        snprintf(p, lens[topic] + 1, "%s/%d/%s", name, id, gTopicSuffixes[topic]);
+        device->topics[topic] = p;
+        p += lens[topic] + 1;
+    }
+    return COMM_OK;
+}
+
+/**
+ * @brief Identifica el topico del primer fragmento de un mensaje
+ */
+static void comm_pending_start(const char* topic, int topic_len)
+{
+    const comm_route_t* route = comm_route_find(topic, topic_len);
+
+    if(route == NULL){
+        gPending.active = 0;
+        return;
+    }
+
+    gPending.active = 1;
+    gPending.value_found = 0;
+    gPending.device = route->device;
+    gPending.message.status = COMM_OK;
+    gPending.message.value = 0;
+    gPending.message.id = route->device->id;
+    gPending.message.received_us = esp_timer_get_time();
+    gPending.message.message_type = route->message_type;
+
+    if(route->message_type == DELAY || route->message_type == REPORT || route->message_type == PING){
+        gPending.report = route->device->report;
+        gPending.report_invalid = 0;
+        gPending.nonce_len = 0;
+        json_stream_init(&gPending.stream, comm_stream_cb, &gPending);
+    }
+}
+
+/**
+ * @brief Entrega el mensaje al callback cuando ha llegado el ultimo fragmento
+ */
+static void comm_pending_finish()
+{
+    if(!gPending.active) return;
+    gPending.active = 0;
+
+    if(gPending.message.message_type == DELAY &&
+       (json_stream_end(&gPending.stream) != 0 || !gPending.value_found)){
+        gPending.message.status = COMM_ERR_INVALID;
+    }
+
+    if(gPending.message.message_type == REPORT){
+        if(json_stream_end(&gPending.stream) != 0 || !gPending.value_found || gPending.report_invalid){
+            comm_device_send_error(gPending.device, INVALID_REPORT);
+        }else{
+            gPending.device->report = gPending.report;
+            ESP_LOGI(TAG_MQTT, "Heartbeat de %d: %d ms", gPending.message.id, gPending.report.heartbeat_ms);
+        }
+        return;
+    }
+
+    if(gPending.message.message_type == PING){
+        if(json_stream_end(&gPending.stream) != 0) gPending.value_found = 0;
+        comm_send_pong(&gPending);
+        return;
+    }
+    if(gPending.device->callback != NULL) gPending.device->callback(gPending.message);
+}
+
+/**
+ * @brief Publica el estado del dispositivo en .../status, retenido y con QoS 1:
+ * {"id": <id>, "online": true, "state": "performance", "delay": 2000}
+ * @details Se publica al conectar (mensaje de nacimiento) y cada vez que cambia. state y delay no
+ * aparecen hasta la primera llamada a comm_device_send_status(). El Last Will publica en el mismo
+ * topico {"id": <id>, "online": false} si la conexion se pierde sin desconectar.
+ */
+static void comm_send_status_message(comm_device_t* device)
+{
+    char buffer[COMM_TEMPLATE_LEN];
+    struct json_out out = JSON_OUT_BUF(buffer, sizeof(buffer));
+    char state[COMM_STATE_LEN];
+    int delay;
+    int len;
+
+    // Copia del estado: comm_device_send_status() puede cambiarlo mientras el manejador de CONNECTED publica
+    portENTER_CRITICAL(&gLink.lock);
+    memcpy(state, device->state, sizeof(state));
+    delay = device->delay;
+    portEXIT_CRITICAL(&gLink.lock);
+
+    len = json_printf(&out, "{id: %d, online: %B", device->id, 1);
+    if(state[0] != '\0'){
+        len += json_printf(&out, ", state: %Q, delay: %d", state, delay);
+    }
+    len += json_printf(&out, "}");
+    if(len < (int) sizeof(buffer)) comm_publish(device, COMM_LANE_PRIORITY, TOPIC_STATUS, buffer, len, 1, 1);
+}
+
+/**
+ * @brief Suscribe los comandos de todos los dispositivos en una sola peticion SUBSCRIBE (config/# y
+ * diag/ping por dispositivo); los mensajes se despachan por topico en comm_pending_start()
+ */
+static void comm_subscribe()
+{
+    esp_mqtt_topic_t filters[2 * COMM_MAX_DEVICES];
+
+    for(int i = 0; i < gDeviceCount; i++){
+        filters[2 * i].filter = gDevices[i].topics[TOPIC_COMMANDS];
+        filters[2 * i].qos = 0;
+        filters[2 * i + 1].filter = gDevices[i].topics[TOPIC_PING];
+        filters[2 * i + 1].qos = 0;
+    }
+    gLink.subscribe_id = esp_mqtt_client_subscribe_multiple(client, filters, 2 * gDeviceCount);
+}
+
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
     // esp_mqtt_event_handle_t es una macro que es un puntero a esp_mqtt_event_t (estructura con los diferentes campos)
     esp_mqtt_event_handle_t event = event_data;
-    int msg_id;
     switch ((esp_mqtt_event_id_t)event_id)
     {
     case MQTT_EVENT_BEFORE_CONNECT:
         ESP_LOGI(TAG_MQTT, "MQTT_EVENT_BIDEFORE_CONNECT");
+        gBrokers.attempt_at = esp_timer_get_time();
         break;
     case MQTT_EVENT_CONNECTED: 
-        msg_id = esp_mqtt_client_subscribe(client, gTopics.on_topic, 0);
-        msg_id = esp_mqtt_client_subscribe(client, gTopics.sleep_topic, 0);
-        msg_id = esp_mqtt_client_subscribe(client, gTopics.config_topic, 0);
-        msg_id = esp_mqtt_client_subscribe(client, gTopics.delay_topic, 0);
+        gConnected = 1;
+        comm_broker_connected();
+#if COMM_MQTT5
+        gAlias.epoch++;
+#endif
+        comm_subscribe();
+        for(int i = 0; i < gDeviceCount; i++){
+            comm_send_status_message(&gDevices[i]);
+            if(gTelemetryMode != COMM_TELEMETRY_SPLIT) comm_send_units(&gDevices[i]);
+        }
+        if(gBacklogTask != NULL) xTaskNotifyGive(gBacklogTask);
         ESP_LOGI(TAG_MQTT, "MQTT_EVENT_CONNECTED");
         break;
     case MQTT_EVENT_DISCONNECTED:
+        if(gConnected) gLink.lost_at = esp_timer_get_time();
+        comm_broker_failed(gConnected);
+        gConnected = 0;
         ESP_LOGI(TAG_MQTT, "MQTT_EVENT_DISCONNECTED");
         break;
+    case MQTT_EVENT_SUBSCRIBED:
+        ESP_LOGI(TAG_MQTT, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
+        if(event->msg_id == gLink.subscribe_id) comm_link_ready();
+        break;
      case MQTT_EVENT_PUBLISHED:
-        ESP_LOGE(TAG_MQTT, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        // PUBACK de una publicacion QoS 1
+        ESP_LOGD(TAG_MQTT, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        comm_inflight_done(event->msg_id, 0);
+        break;
+    case MQTT_EVENT_DELETED:
+        // El cliente ha descartado del outbox un mensaje que no se llego a confirmar
+        ESP_LOGW(TAG_MQTT, "MQTT_EVENT_DELETED, msg_id=%d", event->msg_id);
+        comm_inflight_done(event->msg_id, 1);
         break;
     case MQTT_EVENT_UNSUBSCRIBED:
         ESP_LOGE(TAG_MQTT, "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d\n", event->msg_id);
@@ -57,11 +1421,8 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     case MQTT_EVENT_DATA:
         ESP_LOGI(TAG_MQTT, "MQTT_EVENT_DATA");
 
-        char topic[40];
-        sprintf(topic, "%.*s", event->topic_len,event->topic);
-
         /* 
-            ESP32 esta suscrito a varios topicos:
+            ESP32 esta suscrito a ESP32/1/config/# y atiende estos topicos:
             - ESP32/1/config/ON: Cambia el modo del ESP32 a modo performance
             - ESP32/1/config/configuration: Cambia el modo del ESP32 a modo configuration
             - ESP32/1/config/SLEEP: Cambia el modo del ESP32 a modo off
@@ -73,34 +1434,43 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
                     delay: value
                 }
                 Si value < MIN_DELAY, salta un error "INCORRECT DELAY"
+
+            Tambien esta suscrito a ESP32/1/diag/ping, que se responde desde aqui mismo en diag/pong.
+
+            Si el payload no cabe en el buffer de recepcion, el cliente MQTT lo entrega en varios
+            eventos MQTT_EVENT_DATA consecutivos. Solo el primero trae el topico, por eso el mensaje
+            en curso se guarda en gPending y el payload se parsea en streaming fragmento a fragmento.
         */
-        ESP_LOGI(TAG_MQTT, "TOPIC: %.*s", event->topic_len, event->topic);
-        comm_message_t message;
-        if(strcmp(topic, gTopics.on_topic) == 0)
-        {
-            message.message_type = ON;
-            message.status = COMM_OK;
-            callback_private(message);
-        }else if(strcmp(topic, gTopics.config_topic) == 0)
-        {
-            message.message_type = CONFIG;
-            message.status = COMM_OK;
-            callback_private(message);
-        }else if(strcmp(topic, gTopics.sleep_topic) == 0)
-        {
-            message.message_type = SLEEP;
-            message.status = COMM_OK;
-            callback_private(message);
-        }else if(strcmp(topic, gTopics.delay_topic) == 0)
-        {
-            message.message_type = DELAY;
-            message.status = COMM_OK;
-            message.data = event->data;
-            callback_private(message);
+        if(event->current_data_offset == 0){
+            ESP_LOGI(TAG_MQTT, "TOPIC: %.*s", event->topic_len, event->topic);
+            comm_pending_start(event->topic, event->topic_len);
+        }
+        if(gPending.active && (gPending.message.message_type == DELAY || gPending.message.message_type == REPORT ||
+                               gPending.message.message_type == PING)){
+            json_stream_feed(&gPending.stream, event->data, event->data_len);
+        }
+        if(event->current_data_offset + event->data_len >= event->total_data_len){
+            comm_pending_finish();
         }
         break;
     case MQTT_EVENT_ERROR:
         ESP_LOGI(TAG_MQTT, "MQTT_EVENT_ERROR");
+#if COMM_MQTT5
+        /*
+            Un broker sin MQTT 5 rechaza la conexion por version de protocolo (0x01 en 3.1.1, 0x84 en
+            MQTT 5). Se vuelve a MQTT 3.1.1 sin alias y el cliente reintenta la conexion solo.
+        */
+        if(gAlias.protocol5 && event->error_handle != NULL &&
+           event->error_handle->error_type == MQTT_ERROR_TYPE_CONNECTION_REFUSED &&
+           (event->error_handle->connect_return_code == MQTT_CONNECTION_REFUSE_PROTOCOL ||
+            event->error_handle->connect_return_code == 0x84)){
+            ESP_LOGW(TAG_MQTT, "El broker no admite MQTT 5, se usa MQTT 3.1.1");
+            gAlias.protocol5 = 0;
+            gBrokers.keep = 1; // El broker no ha fallado: se reintenta el mismo
+            gMqttConf.session.protocol_ver = MQTT_PROTOCOL_V_3_1_1;
+            esp_mqtt_set_config(client, &gMqttConf);
+        }
+#endif
         break;
     default:
         ESP_LOGI(TAG_MQTT, "UNKNOWN EVENT id:%d", event->event_id);
@@ -108,68 +1478,258 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     }
 }
 
-void comm_init(comm_callback callback, char* device, int id)
+comm_device_t* comm_device_add(comm_callback callback, const char* name, int id)
 {
-    callback_private = callback;
-    id_device = id;
-
-    snprintf(gTopics.on_topic, MAX_LEN_TOPIC, "%s/%d/config/ON", device, id);
-    snprintf(gTopics.sleep_topic, MAX_LEN_TOPIC, "%s/%d/config/SLEEP", device, id);
-    snprintf(gTopics.config_topic, MAX_LEN_TOPIC, "%s/%d/config/CONFIG", device, id);
-    snprintf(gTopics.delay_topic, MAX_LEN_TOPIC, "%s/%d/config/DELAY", device, id);
-    snprintf(gTopics.temperature_topic, MAX_LEN_TOPIC, "%s/%d/telemetry/temperature", device, id);
-    snprintf(gTopics.humidicity_topic, MAX_LEN_TOPIC, "%s/%d/telemetry/humidicity", device, id);
-    snprintf(gTopics.light_topic, MAX_LEN_TOPIC, "%s/%d/telemetry/light", device, id);
-    snprintf(gTopics.error_topic, MAX_LEN_DEVICE, "%s/%d/error", device, id);
+    comm_device_t* device;
+
+    if(client != NULL || gDeviceCount >= COMM_MAX_DEVICES) return NULL;
+    device = &gDevices[gDeviceCount];
+
+    if(comm_topics_init(device, name, id) != COMM_OK){
+        ESP_LOGE(TAG_MQTT, "No se pueden crear los topicos de %s/%d", name, id);
+        return NULL;
+    }
+    device->id = id;
+    device->index = gDeviceCount;
+    device->callback = callback;
+    device->report.heartbeat_ms = COMM_DEFAULT_HEARTBEAT_MS;
+    portMUX_INITIALIZE(&device->ring.lock);
+
+    // Topicos de comandos: para atender uno nuevo basta con registrarlo aqui
+    comm_route_add(device, TOPIC_ON, ON);
+    comm_route_add(device, TOPIC_SLEEP, SLEEP);
+    comm_route_add(device, TOPIC_CONFIG, CONFIG);
+    comm_route_add(device, TOPIC_DELAY, DELAY);
+    comm_route_add(device, TOPIC_REPORT, REPORT);
+    comm_route_add(device, TOPIC_PING, PING);
+
+    for(int encoding = 0; encoding < COMM_ENCODING_COUNT; encoding++){
+        comm_templates_t* templates = &device->templates[encoding];
+        int cbor = encoding == COMM_ENCODING_CBOR;
+        for(int field = 0; field < FIELD_COUNT; field++){
+            if(template_init(&templates->fields[field], cbor, &gFields[field], 1, id) != 0){
+                ESP_LOGE(TAG_MQTT, "Plantilla de telemetria demasiado larga: %s", gFields[field].key);
+            }
+        }
+        if(template_init(&templates->combined, cbor, gFields, FIELD_COUNT, id) != 0){
+            ESP_LOGE(TAG_MQTT, "Plantilla de telemetria demasiado larga: %s", gFields[0].key);
+        }
+    }
+
+    gDeviceCount++;
+    return device;
+}
+
+eComm_err comm_start(void)
+{
+    static char will[COMM_WILL_LEN]; // El cliente guarda el puntero: debe seguir siendo valido
+    struct json_out out = JSON_OUT_BUF(will, sizeof(will));
+
+    if(client != NULL || gDeviceCount == 0) return COMM_ERR_INVALID;
+    if(comm_brokers_init() == 0){
+        ESP_LOGE(TAG_MQTT, "Lista de brokers vacia: %s", broker_uris);
+        return COMM_ERR_INVALID;
+    }
+
+    /*
+        MQTT admite un solo Last Will por conexion: en modo gateway solo el primer dispositivo pasa a
+        online: false si se cae la conexion. Los demas conservan su ultimo estado retenido; quien los lea
+        debe darlos por desconectados junto con el primero, ya que comparten la conexion.
+    */
+    if(json_printf(&out, "{id: %d, online: %B}", gDevices[0].id, 0) >= (int) sizeof(will)){
+        ESP_LOGE(TAG_MQTT, "Last Will demasiado largo para el id %d", gDevices[0].id);
+        return COMM_ERR_INVALID;
+    }
+
     /**
         No se configura id_cliente porque usa por defecto: ESP32_CHIPID% donde CHIPID% son los
         ultimos 3 bytes(hex) de la MAC.
     */
-    esp_mqtt_client_config_t mqtt_conf = {
-        .broker.address.uri = broker_uri,
+    gMqttConf = (esp_mqtt_client_config_t){
+        .broker.address.uri = gBrokers.list[0].uri,
         .credentials.username = username,
-        .credentials.authentication.password = password
+        .credentials.authentication.password = password,
+        .session.last_will.topic = gDevices[0].topics[TOPIC_STATUS],
+        .session.last_will.msg = will,
+        .session.last_will.qos = 1,
+        .session.last_will.retain = 1,
+#if COMM_MQTT5
+        .session.protocol_ver = MQTT_PROTOCOL_V_5,
+#endif
     };
-    client = esp_mqtt_client_init(&mqtt_conf);
+    if(gBrokers.count > 1) gMqttConf.network.reconnect_timeout_ms = COMM_RECONNECT_MS;
+#if COMM_MQTT5
+    gAlias.lock = xSemaphoreCreateMutex();
+#endif
+    gPublisher.lanes[COMM_LANE_PRIORITY] = xQueueCreate(COMM_PRIORITY_LANE_LEN, sizeof(comm_publish_t));
+    gPublisher.lanes[COMM_LANE_BULK] = xQueueCreate(COMM_BULK_LANE_LEN, sizeof(comm_publish_t));
+    xTaskCreate(vCommPublishTask, "Comm publish", 3072, NULL, 5, &gPublisher.task);
+    xTaskCreate(vCommBacklogTask, "Comm backlog", 3072, NULL, 4, &gBacklogTask);
+
+    gLink.lost_at = esp_timer_get_time();
+    client = esp_mqtt_client_init(&gMqttConf);
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
     ESP_ERROR_CHECK(esp_mqtt_client_start(client));
     ESP_LOGI(TAG_MQTT,"APP MQTT START\n");
+    return COMM_OK;
+}
+
+void comm_init(comm_callback callback, char* device, int id)
+{
+    if(comm_device_add(callback, device, id) == NULL) return;
+    comm_start();
+}
+
+eComm_err comm_device_send_telemetry(comm_device_t* device, comm_telemetry_t* data){
+    comm_templates_t* templates = &device->templates[gEncoding];
+    int values[FIELD_COUNT];
+    int due[FIELD_COUNT];
+    int len;
+
+    // Los lotes suponen un periodo fijo: no se aplica la banda muerta
+    if(gTelemetryMode == COMM_TELEMETRY_BATCH){
+        comm_batch_push(device, data);
+        return COMM_OK;
+    }
+    if(device->batch.count > 0 && gConnected){
+        comm_batch_flush(device, device->batch.count); // Lote a medias de antes de cambiar de modo
+    }
+
+    // Sin conexion la muestra se guarda entera y se publica al reconectar
+    if(!gConnected){
+        comm_ring_push(&device->ring, data);
+        return COMM_OK;
+    }
+
+    // La banda muerta solo filtra las publicaciones en directo
+    comm_telemetry_values(data, values);
+    if(comm_report_due(device, values, due) == 0) return COMM_OK;
+
+    if(gTelemetryMode != COMM_TELEMETRY_COMBINED){
+        for(int field = 0; field < FIELD_COUNT; field++){
+            if(!due[field]) continue;
+            len = template_fill(&templates->fields[field], &values[field]);
+            if(len > 0) comm_publish(device, COMM_LANE_BULK, gFieldTopics[field], templates->fields[field].buffer,
+                                     len, gTelemetryQos, COMM_RETAIN_TELEMETRY);
+        }
+    }
+    if(gTelemetryMode != COMM_TELEMETRY_SPLIT){
+        unsigned mask = 0;
+        for(int field = 0; field < FIELD_COUNT; field++){
+            if(due[field]) mask |= 1u << field;
+        }
+        len = template_fill_mask(&templates->combined, values, mask);
+        if(len > 0) comm_publish(device, COMM_LANE_BULK, TOPIC_TELEMETRY, templates->combined.buffer, len,
+                                 gTelemetryQos, COMM_RETAIN_TELEMETRY);
+    }
+
+    return COMM_OK;
 }
 
 eComm_err comm_send_telemetry(comm_telemetry_t* data){
-    char buffer[128];
+    if(gDeviceCount == 0) return COMM_ERR_INVALID;
+    return comm_device_send_telemetry(&gDevices[0], data);
+}
 
-    struct json_out out_temperature = JSON_OUT_BUF(buffer, sizeof(buffer));
-    json_printf(&out_temperature, "{id: %d, temperature: %d, unidad: %s}", id_device, data->temperature, "Celsius");    
-    esp_mqtt_client_publish(client,gTopics.temperature_topic, buffer, 0, 0, 0);
-    
-    struct json_out out_humidicity = JSON_OUT_BUF(buffer, sizeof(buffer));
-    json_printf(&out_humidicity, "{id: %d, humidicity: %d, unidad: %s}", id_device, data->humicity, "percentage");
-    esp_mqtt_client_publish(client,gTopics.humidicity_topic, buffer, 0, 0, 0);
+eComm_err comm_set_encoding(eComm_encoding encoding){
+    if(encoding >= COMM_ENCODING_COUNT) return COMM_ERR_INVALID;
+    gEncoding = encoding;
+    return COMM_OK;
+}
 
-    struct json_out out_light = JSON_OUT_BUF(buffer, sizeof(buffer));
-    json_printf(&out_light, "{id: %d, light: %d, unidad: %s}", id_device, data->light, "bool");
-    esp_mqtt_client_publish(client,gTopics.light_topic, buffer, 0, 0, 0);
+void comm_device_get_ring_stats(comm_device_t* device, comm_ring_stats_t* stats){
+    portENTER_CRITICAL(&device->ring.lock);
+    *stats = device->ring.stats;
+    stats->pending = device->ring.count;
+    portEXIT_CRITICAL(&device->ring.lock);
+}
+
+void comm_get_ring_stats(comm_ring_stats_t* stats){
+    if(gDeviceCount > 0) comm_device_get_ring_stats(&gDevices[0], stats);
+}
 
+eComm_err comm_set_telemetry_mode(eComm_telemetry_mode mode){
+    if(mode > COMM_TELEMETRY_BATCH) return COMM_ERR_INVALID;
+    if(mode != COMM_TELEMETRY_SPLIT && gTelemetryMode == COMM_TELEMETRY_SPLIT && client != NULL){
+        for(int i = 0; i < gDeviceCount; i++){
+            comm_send_units(&gDevices[i]);
+        }
+    }
+    gTelemetryMode = mode;
+    return COMM_OK;
+}
+
+void comm_get_publish_stats(eComm_lane lane, comm_lane_stats_t* stats){
+    if(lane >= COMM_LANE_COUNT) return;
+    portENTER_CRITICAL(&gPublisher.lock);
+    *stats = gPublisher.stats[lane];
+    portEXIT_CRITICAL(&gPublisher.lock);
+}
+
+eComm_err comm_set_drop_policy(eComm_drop_policy policy){
+    if(policy > COMM_DROP_OLDEST) return COMM_ERR_INVALID;
+    gPublisher.drop_policy = policy;
+    return COMM_OK;
+}
+
+eComm_err comm_set_batch_size(int samples){
+    if(samples < 2 || samples > COMM_BATCH_LEN) return COMM_ERR_INVALID;
+    gBatchSize = samples;
+    return COMM_OK;
+}
+
+eComm_err comm_set_telemetry_qos(int qos){
+    if(qos < 0 || qos > 1) return COMM_ERR_INVALID;
+    gTelemetryQos = qos;
     return COMM_OK;
 }
 
-eComm_error_type comm_send_error(eComm_error_type error){
+void comm_get_link_stats(comm_link_stats_t* stats){
+    portENTER_CRITICAL(&gLink.lock);
+    *stats = gLink.stats;
+    portEXIT_CRITICAL(&gLink.lock);
+}
+
+void comm_get_qos_stats(comm_qos_stats_t* stats){
+    portENTER_CRITICAL(&gQos.lock);
+    *stats = gQos.stats;
+    portEXIT_CRITICAL(&gQos.lock);
+}
+
+eComm_err comm_device_send_error(comm_device_t* device, eComm_error_type error){
+    static const char* const names[] = {
+        [INVALID_STATE] = "INVALID_STATE",
+        [INVALID_DELAY] = "INVALID_DELAY",
+        [INVALID_REPORT] = "INVALID_REPORT",
+    };
     char buffer[128];
     struct json_out out = JSON_OUT_BUF(buffer, sizeof(buffer));
-    
-    switch (error)
-    {
-    case INVALID_STATE:
-        json_printf(&out, "{id: %d, error: INVALID_STATE}", id_device);
-        esp_mqtt_client_publish(client,gTopics.error_topic, buffer, 0, 0, 0);
-        break;
-    case INVALID_DELAY:
-        json_printf(&out, "{id: %d, error: INVALID_DELAY}", id_device);
-        esp_mqtt_client_publish(client,gTopics.error_topic, buffer, 0, 0, 0);
-    default:
-        break;
-    }
+    int len;
+
+    if(error >= sizeof(names) / sizeof(names[0])) return COMM_ERR_INVALID;
 
+    len = json_printf(&out, "{id: %d, error: %Q}", device->id, names[error]);
+    return comm_publish(device, COMM_LANE_PRIORITY, TOPIC_ERROR, buffer, len, 0, 0);
+}
+
+eComm_err comm_device_send_status(comm_device_t* device, const char* state, int delay){
+    if(state == NULL || strlen(state) >= sizeof(device->state)) return COMM_ERR_INVALID;
+
+    portENTER_CRITICAL(&gLink.lock);
+    strcpy(device->state, state);
+    device->delay = delay;
+    portEXIT_CRITICAL(&gLink.lock);
+    // Sin conexion basta con guardarlo: se publica como mensaje de nacimiento al conectar
+    if(gConnected) comm_send_status_message(device);
     return COMM_OK;
 }
+
+eComm_err comm_send_status(const char* state, int delay){
+    if(gDeviceCount == 0) return COMM_ERR_INVALID;
+    return comm_device_send_status(&gDevices[0], state, delay);
+}
+
+eComm_err comm_send_error(eComm_error_type error){
+    if(gDeviceCount == 0) return COMM_ERR_INVALID;
+    return comm_device_send_error(&gDevices[0], error);
+}
@@ -12,19 +12,212 @@
 #include "esp_log.h"
 #include "frozen.h" // Libreria necesaria para crear json strings
 #include "board_definition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
 
-#define MAX_LEN_DEVICE 10
 #define MAX_LEN_TOPIC 128
 
+/*
+ * Presupuesto de RAM por dispositivo logico (ESP32, tamaños por defecto). Todo es estatico y se
+ * reserva para COMM_MAX_DEVICES aunque se registren menos dispositivos:
+ * - Plantillas de telemetria, 4 por codificacion: 2 x 4 x 296 = ~2.4 KB
+ * - Lote del modo COMM_TELEMETRY_BATCH: 16 x COMM_BATCH_LEN + 5 x 3 x COMM_BATCH_LEN = ~1.9 KB
+ * - Buffer de desconexion: 16 x COMM_RING_LEN = ~1 KB
+ * - Topicos, bandas muertas y estado: ~0.3 KB
+ * - Tabla de despacho de comandos (16 huecos) y alias MQTT 5: ~0.35 KB
+ * Unos 6 KB por dispositivo, mas sus topicos en el heap (~0.4 KB con "ESP32/<id>", el tamaño justo
+ * de los nombres registrados). Comun a todos: el mensaje de un lote del buffer al reconectar
+ * (COMM_RING_BATCH x COMM_TEMPLATE_LEN = 1 KB) y los carriles de publicacion.
+ */
+#ifndef COMM_MAX_DEVICES
+#define COMM_MAX_DEVICES 1 // Dispositivos logicos que comparten la conexion MQTT (modo gateway)
+#endif
+#define COMM_ROUTES_LEN (16 * COMM_MAX_DEVICES) // Huecos de la tabla de despacho de comandos, al menos el doble de topicos de comandos
+#define COMM_TEMPLATE_LEN 128 // Longitud maxima de un payload de telemetria
+
+#ifndef COMM_DEFAULT_HEARTBEAT_MS
+#define COMM_DEFAULT_HEARTBEAT_MS 60000 // Maximo tiempo sin publicar una metrica aunque no cambie
+#endif
+
+#ifndef COMM_PRIORITY_LANE_LEN
+#define COMM_PRIORITY_LANE_LEN 4 // Mensajes en cola en el carril prioritario (errores, alertas)
+#endif
+#ifndef COMM_BULK_LANE_LEN
+#define COMM_BULK_LANE_LEN 8 // Mensajes en cola en el carril de telemetria
+#endif
+
+#ifndef COMM_BATCH_LEN
+#define COMM_BATCH_LEN 60 // Maximo de muestras por lote en el modo COMM_TELEMETRY_BATCH
+#endif
+#ifndef COMM_DEFAULT_BATCH_SIZE
+#define COMM_DEFAULT_BATCH_SIZE 30 // Muestras por lote: un minuto con el periodo minimo de 2 s
+#endif
+
+#ifndef COMM_RETAIN_TELEMETRY
+#define COMM_RETAIN_TELEMETRY 1 // La ultima muestra de cada metrica queda retenida en el broker para los nuevos suscriptores
+#endif
+
+#ifndef COMM_DEFAULT_TELEMETRY_QOS
+#define COMM_DEFAULT_TELEMETRY_QOS 0 // 1: la telemetria se publica con QoS 1 y se mide la latencia hasta el PUBACK
+#endif
+#ifndef COMM_INFLIGHT_LEN
+#define COMM_INFLIGHT_LEN 16 // Publicaciones QoS 1 pendientes de PUBACK que se siguen a la vez
+#endif
+#ifndef COMM_INFLIGHT_TIMEOUT_MS
+#define COMM_INFLIGHT_TIMEOUT_MS 10000 // Sin PUBACK en este tiempo la publicacion se cuenta como perdida
+#endif
+#ifndef COMM_DIAG_PERIOD_MS
+#define COMM_DIAG_PERIOD_MS 60000 // Periodo de publicacion de las metricas de entrega en .../diag/publish
+#endif
+#define COMM_LATENCY_BUCKETS 8 // Intervalos del histograma: <10, <25, <50, <100, <250, <500, <1000, >=1000 ms
+
+#ifndef COMM_MQTT5
+#define COMM_MQTT5 CONFIG_MQTT_PROTOCOL_5 // MQTT 5 con alias de topico; requiere MQTT 5 en el cliente esp-mqtt
+#endif
+
+#ifndef COMM_BROKER_URIS
+#define COMM_BROKER_URIS CONFIG_BROKER_URI // Lista de brokers separados por comas: "mqtt://a:1883,mqtt://b:1883"
+#endif
+#ifndef COMM_MAX_BROKERS
+#define COMM_MAX_BROKERS 4
+#endif
+#ifndef COMM_BROKER_RETRY_MS
+#define COMM_BROKER_RETRY_MS 30000 // Un broker que falla no se vuelve a elegir en este tiempo, salvo que fallen todos
+#endif
+#ifndef COMM_RECONNECT_MS
+#define COMM_RECONNECT_MS 1000 // Espera antes de reconectar cuando hay varios brokers (esp-mqtt espera 10 s)
+#endif
+
+#ifndef COMM_RING_LEN
+#define COMM_RING_LEN 64 // Muestras que se guardan mientras no hay conexion con el broker
+#endif
+#ifndef COMM_RING_BATCH
+#define COMM_RING_BATCH 8 // Muestras por mensaje al vaciar el buffer
+#endif
+#ifndef COMM_RING_PERIOD_MS
+#define COMM_RING_PERIOD_MS 250 // Pausa entre mensajes al vaciar el buffer
+#endif
+#ifndef COMM_RING_RETRIES
+#define COMM_RING_RETRIES 3 // Fallos seguidos al publicar un lote antes de esperar a la siguiente reconexion
+#endif
+
 /**
  * @brief Estructura que agrupa los datos enviados al topico telemetria
  */
 typedef struct{
     uint8_t humicity;
+    uint8_t humicity_dec; // Decimas, se publica como humicity.humicity_dec
     uint8_t temperature;
+    uint8_t temperature_dec;
     uint8_t light;
 }comm_telemetry_t;
 
+/**
+ * @brief Codificacion de los payloads de telemetria
+ * 
+ * - JSON: {"id": 1, "temperature": 23.4, "unidad": "Celsius"}
+ * - CBOR: el mismo mapa sin la unidad (implicita en el topico), con los valores decimales como
+ *   fraccion decimal (tag 4). Ocupa menos de la mitad que el JSON.
+ */
+typedef enum{
+    COMM_ENCODING_JSON,
+    COMM_ENCODING_CBOR,
+    COMM_ENCODING_COUNT
+}eComm_encoding;
+
+#ifndef COMM_DEFAULT_ENCODING
+#define COMM_DEFAULT_ENCODING COMM_ENCODING_JSON
+#endif
+
+/**
+ * @brief Forma de publicar cada muestra de telemetria
+ */
+typedef enum{
+    COMM_TELEMETRY_SPLIT,    // Un mensaje por metrica en .../telemetry/<metrica>, con su unidad
+    COMM_TELEMETRY_COMBINED, // Un unico mensaje .../telemetry con todas las metricas
+    COMM_TELEMETRY_BOTH,     // Ambos, mientras los consumidores migran al combinado
+    COMM_TELEMETRY_BATCH     // Lotes binarios de varias muestras en .../telemetry/batch (deltas y varint)
+}eComm_telemetry_mode;
+
+#ifndef COMM_DEFAULT_TELEMETRY_MODE
+#define COMM_DEFAULT_TELEMETRY_MODE COMM_TELEMETRY_SPLIT
+#endif
+
+/**
+ * @brief Contadores del buffer de telemetria para las desconexiones
+ */
+typedef struct{
+    uint32_t buffered;  // Muestras guardadas desde el arranque
+    uint32_t overflows; // Muestras perdidas: el buffer estaba lleno y se sobrescribio la mas antigua
+    uint32_t replayed;  // Muestras publicadas desde el buffer tras reconectar (buffered = overflows + replayed + pending)
+    uint32_t pending;   // Muestras en el buffer ahora mismo
+}comm_ring_stats_t;
+
+/**
+ * @brief Carriles de publicacion. El prioritario se vacia siempre antes que el de telemetria.
+ */
+typedef enum{
+    COMM_LANE_PRIORITY, // Errores, alertas y mensajes de estado
+    COMM_LANE_BULK,     // Telemetria
+    COMM_LANE_COUNT
+}eComm_lane;
+
+/**
+ * @brief Que mensaje se descarta cuando el carril esta lleno
+ */
+typedef enum{
+    COMM_DROP_NEWEST, // Se descarta el mensaje nuevo
+    COMM_DROP_OLDEST  // Se descarta el mas antiguo de la cola para hacer sitio al nuevo
+}eComm_drop_policy;
+
+#ifndef COMM_DEFAULT_DROP_POLICY
+#define COMM_DEFAULT_DROP_POLICY COMM_DROP_OLDEST
+#endif
+
+/**
+ * @brief Contadores de un carril de publicacion
+ */
+typedef struct{
+    uint32_t queued;           // Mensajes encolados
+    uint32_t published;        // Mensajes entregados al cliente MQTT
+    uint32_t dropped;          // Mensajes descartados por cola llena o payload demasiado largo
+    uint32_t latency_max_us;   // Maximo tiempo en cola
+    uint64_t latency_total_us; // Suma del tiempo en cola; la media es latency_total_us / published
+}comm_lane_stats_t;
+
+/**
+ * @brief Contadores de entrega de las publicaciones QoS 1 (desde que se entregan al cliente hasta el PUBACK)
+ */
+typedef struct{
+    uint32_t sent;      // Publicaciones QoS 1 seguidas
+    uint32_t acked;     // PUBACK recibidos
+    uint32_t lost;      // Sin PUBACK en COMM_INFLIGHT_TIMEOUT_MS o descartadas del outbox del cliente
+    uint32_t untracked; // No se han podido seguir: tabla llena o PUBACK de una publicacion desconocida
+    uint32_t inflight;  // Pendientes de PUBACK ahora mismo
+    uint32_t latency_max_ms;
+    uint64_t latency_total_ms; // La media es latency_total_ms / acked
+    uint32_t histogram[COMM_LATENCY_BUCKETS];
+}comm_qos_stats_t;
+
+/**
+ * @brief Contadores de la conexion con el broker
+ * @details "Listo" es cuando el broker confirma la suscripcion a los comandos (SUBACK): desde ese momento
+ * el dispositivo atiende ordenes. El tiempo se mide desde que se pierde la conexion (o desde comm_init()).
+ */
+typedef struct{
+    uint32_t connects;      // Conexiones completadas, la primera incluida
+    uint32_t ready_ms;      // Tiempo hasta estar listo en la ultima conexion
+    uint32_t ready_max_ms;
+    uint32_t broker;        // Posicion en COMM_BROKER_URIS del broker de la ultima conexion
+    uint32_t connect_ms;    // Tiempo de conexion (TCP, TLS y CONNACK) de la ultima conexion
+    uint32_t failovers;     // Conexiones a un broker distinto del que se perdio
+    uint32_t failover_ms;   // Desde que se perdio un broker hasta conectar con otro, en el ultimo cambio
+    uint32_t failover_max_ms;
+}comm_link_stats_t;
+
 /**
  * @brief Especifica los errores que ocurren en MQTT
  */
@@ -40,7 +233,9 @@ typedef enum{
     ON,
     SLEEP,
     CONFIG,
-    DELAY
+    DELAY,
+    REPORT, // Configuracion de la banda muerta y el heartbeat. Se atiende en el modulo, no llega al callback
+    PING    // Sondeo de latencia en .../diag/ping. Se responde en el modulo, no llega al callback
 }eComm_message_type;
 
 /**
@@ -49,6 +244,7 @@ typedef enum{
 typedef enum{
     INVALID_STATE,
     INVALID_DELAY,
+    INVALID_REPORT,
 }eComm_error_type;
 
 /**
@@ -57,18 +253,117 @@ typedef enum{
 typedef struct{
     eComm_err status;
     eComm_message_type message_type;
-    char* data;
+    int value; // Valor recibido en el payload (DELAY: campo "delay"). Solo valido si status == COMM_OK
+    int id;    // Id del dispositivo logico al que va dirigido el comando
+    int64_t received_us; // esp_timer_get_time() al llegar el comando al manejador MQTT, para medir la latencia hasta aplicarlo
 }comm_message_t;
 
 typedef void(*comm_callback)(comm_message_t message);
 
+/**
+ * @brief Dispositivo logico: <device>/<id> con sus topicos, su telemetria y su buffer de desconexion
+ */
+typedef struct comm_device comm_device_t;
+
 /**
  * @brief Configuracion y conexion con el broker MQTT
  * @param callback Funcion para recibir los datos de la suscripcion a los topicos
  * @details Configura los parametros necesarios como el broker uri, credenciales, client_id para poder
- * iniciar cliente MQTT y registrar el manejor de eventos MQTT
+ * iniciar cliente MQTT y registrar el manejor de eventos MQTT. Equivale a comm_device_add() y
+ * comm_start() con un solo dispositivo; comm_send_telemetry(), comm_send_error(), comm_send_status() y
+ * comm_get_ring_stats() actuan sobre ese dispositivo.
+ * Registra un Last Will retenido en .../status ({"id": <id>, "online": false}) y al conectar publica
+ * en el mismo topico, retenido, el mensaje de nacimiento con el ultimo estado de comm_send_status().
  */
 void comm_init(comm_callback callback, char* device, int id);
 eComm_err comm_send_telemetry(comm_telemetry_t* data);
+
+/**
+ * @brief Modo gateway: registra un dispositivo logico que compartira la conexion MQTT
+ * @details Se llama antes de comm_start(), hasta COMM_MAX_DEVICES veces. Cada dispositivo tiene sus
+ * topicos, plantillas, banda muerta, lotes y buffer de desconexion; todos comparten el cliente MQTT,
+ * los carriles de publicacion y una unica peticion SUBSCRIBE con el config/# de cada uno.
+ * Los diagnosticos de la conexion (diag/...) se publican en los topicos del primer dispositivo.
+ * El Last Will tambien es unico y solo cubre al primer dispositivo: si la conexion se cae, los demas
+ * siguen con su ultimo status retenido (online: true) y hay que darlos por desconectados con el primero.
+ * @return Handle del dispositivo o NULL si no caben mas, ya se ha llamado a comm_start() o no hay memoria
+ */
+comm_device_t* comm_device_add(comm_callback callback, const char* device, int id);
+
+/**
+ * @brief Conecta con el broker y arranca las tareas de publicacion con los dispositivos registrados
+ */
+eComm_err comm_start(void);
+
+eComm_err comm_device_send_telemetry(comm_device_t* device, comm_telemetry_t* data);
+eComm_err comm_device_send_error(comm_device_t* device, eComm_error_type error);
+eComm_err comm_device_send_status(comm_device_t* device, const char* state, int delay);
+void comm_device_get_ring_stats(comm_device_t* device, comm_ring_stats_t* stats);
+
+/**
+ * @brief Selecciona la codificacion de la telemetria. Los mensajes de error siempre son JSON.
+ */
+eComm_err comm_set_encoding(eComm_encoding encoding);
+
+/**
+ * @brief Selecciona si la telemetria se publica por metrica, combinada o de ambas formas.
+ * @details En modo combinado las unidades se publican una sola vez, retenidas, en .../telemetry/units
+ */
+eComm_err comm_set_telemetry_mode(eComm_telemetry_mode mode);
+
+/**
+ * @brief Numero de muestras de cada lote en el modo COMM_TELEMETRY_BATCH (2..COMM_BATCH_LEN)
+ * @details El lote se publica antes si no cabe en COMM_TEMPLATE_LEN bytes o si cambia el periodo de muestreo.
+ */
+eComm_err comm_set_batch_size(int samples);
+
+/**
+ * @brief Copia los contadores del buffer de telemetria
+ * @details Mientras no hay conexion con el broker comm_send_telemetry() guarda las muestras en un
+ * buffer circular de COMM_RING_LEN muestras. Al reconectar se publican en .../telemetry/backlog,
+ * COMM_RING_BATCH muestras por mensaje y un mensaje cada COMM_RING_PERIOD_MS.
+ */
+void comm_get_ring_stats(comm_ring_stats_t* stats);
+
+/**
+ * @brief Copia los contadores de un carril de publicacion
+ * @details Los mensajes no se publican desde la tarea que llama a comm_send_*(): se encolan en su
+ * carril y una tarea propia los pasa al cliente con esp_mqtt_client_enqueue(), sin esperar al socket.
+ */
+void comm_get_publish_stats(eComm_lane lane, comm_lane_stats_t* stats);
+
+/**
+ * @brief Selecciona que mensaje se descarta cuando un carril esta lleno
+ */
+eComm_err comm_set_drop_policy(eComm_drop_policy policy);
+
+/**
+ * @brief Selecciona el QoS de la telemetria (0 o 1)
+ * @details Con QoS 1 cada publicacion se anota con su msg_id y la hora de envio hasta que llega su
+ * PUBACK. La latencia y las perdidas se publican cada COMM_DIAG_PERIOD_MS en .../diag/publish.
+ */
+eComm_err comm_set_telemetry_qos(int qos);
+
+/**
+ * @brief Copia los contadores de entrega de las publicaciones QoS 1
+ */
+void comm_get_qos_stats(comm_qos_stats_t* stats);
+
+/**
+ * @brief Copia los contadores de la conexion con el broker. Tambien se publican en .../diag/link
+ * cada vez que el dispositivo queda listo tras conectar, y los del broker en .../diag/broker al conectar.
+ * @details Con varios brokers en COMM_BROKER_URIS, al perder la conexion o fallar un intento se marca
+ * el broker como caido durante COMM_BROKER_RETRY_MS y se conecta con el mas rapido de los demas segun su
+ * tiempo de conexion medido. Los que no se han medido todavia se prueban primero, en el orden de la lista.
+ */
+void comm_get_link_stats(comm_link_stats_t* stats);
 eComm_err comm_send_error(eComm_error_type error);
+
+/**
+ * @brief Publica el estado de la FSM y el delay en .../status, retenido, para que un dashboard recien
+ * abierto lo reciba al suscribirse: {"id": <id>, "online": true, "state": <state>, "delay": <delay>}
+ * @details Se guarda y se vuelve a publicar en cada conexion. Sin conexion solo se guarda.
+ * @param state Nombre del estado, menos de 16 caracteres
+ */
+eComm_err comm_send_status(const char* state, int delay);
 #endif
\ No newline at end of file
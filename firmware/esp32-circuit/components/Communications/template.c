@@ -0,0 +1,93 @@
+/**
+ * @file template.c
+ * @brief Implementacion de las plantillas de telemetria.
+ */
+
+#include <string.h>
+#include "frozen.h"
+#include "cbor.h"
+#include "template.h"
+
+int template_init(template_t* template, int cbor, const template_field_t* fields, int num_fields, int id)
+{
+    int len = 0;
+
+    template->cbor = cbor;
+    template->num_fields = num_fields;
+    template->tail_len = 0;
+    for(int i = 0; i < num_fields; i++){
+        template->decimals[i] = fields[i].decimals;
+    }
+
+    if(cbor){
+        // El numero de elementos del mapa se corrige en template_fill_mask() segun las metricas incluidas
+        uint8_t* p = (uint8_t*)template->buffer;
+        p += cbor_put_head(p, CBOR_MAJOR_MAP, 1 + num_fields);
+        p += cbor_put_text(p, "id");
+        p += cbor_put_int(p, id);
+        template->prefix_len = p - (uint8_t*)template->buffer;
+
+        for(int i = 0; i < num_fields; i++){
+            template->key_len[i] = cbor_put_text((uint8_t*)template->keys + len, fields[i].key);
+            len += template->key_len[i];
+        }
+    }else{
+        struct json_out out_prefix = JSON_OUT_BUF(template->buffer, sizeof(template->buffer));
+        template->prefix_len = json_printf(&out_prefix, "{id: %d", id);
+
+        for(int i = 0; i <= num_fields && len < (int) sizeof(template->keys); i++){
+            struct json_out out = JSON_OUT_BUF(template->keys + len, sizeof(template->keys) - len);
+            if(i < num_fields){
+                template->key_len[i] = json_printf(&out, ", %Q: ", fields[i].key);
+                len += template->key_len[i];
+            }else{
+                template->tail_len = num_fields == 1 ? json_printf(&out, ", unidad: %Q}", fields[0].unit)
+                                                     : json_printf(&out, "}");
+                len += template->tail_len;
+            }
+        }
+    }
+
+    // Hueco para cada valor ("-2147483648" + '.') y el terminador
+    if(template->prefix_len + 12 * num_fields + len + 1 > TEMPLATE_LEN){
+        template->prefix_len = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int template_fill_mask(template_t* template, const int* values, unsigned mask)
+{
+    if(template->prefix_len < 0) return 0;
+
+    char* p = template->buffer + template->prefix_len;
+    const char* key = template->keys;
+    int count = 0;
+    for(int i = 0; i < template->num_fields; i++){
+        if(mask & (1u << i)){
+            memcpy(p, key, template->key_len[i]);
+            p += template->key_len[i];
+            if(template->cbor){
+                p += cbor_put_fixed((uint8_t*)p, values[i], template->decimals[i]);
+            }else{
+                p += json_format_fixed(p, values[i], template->decimals[i]);
+            }
+            count++;
+        }
+        key += template->key_len[i];
+    }
+    if(count == 0) return 0;
+    memcpy(p, key, template->tail_len);
+    p += template->tail_len;
+    *p = '\0';
+
+    if(template->cbor){
+        cbor_put_head((uint8_t*)template->buffer, CBOR_MAJOR_MAP, 1 + count); // Menos de 24: un byte
+    }
+    return p - template->buffer;
+}
+
+int template_fill(template_t* template, const int* values)
+{
+    return template_fill_mask(template, values, (1u << template->num_fields) - 1);
+}
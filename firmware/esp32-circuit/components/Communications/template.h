@@ -0,0 +1,60 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+/**
+ * @file template.h
+ * @brief Plantillas precompiladas de los payloads de telemetria
+ * @details La parte constante del mensaje (id, claves y unidad) se serializa una sola vez con
+ * template_init(): el prefijo se queda fijo al principio de buffer y las claves y el cierre se guardan
+ * aparte. En cada muestra template_fill() solo copia la clave de cada valor y escribe el valor,
+ * evitando volver a interpretar el formato de json_printf por cada publicacion.
+ */
+
+#include <stdint.h>
+
+#define TEMPLATE_LEN 128 // Longitud maxima del payload, la misma que COMM_TEMPLATE_LEN
+#define TEMPLATE_MAX_FIELDS 3
+
+/**
+ * @brief Metrica de telemetria: clave en el payload, unidad y decimales del valor en punto fijo
+ */
+typedef struct{
+    const char* key;
+    const char* unit;
+    int decimals; // 23.4 -> 234 con 1 decimal
+}template_field_t;
+
+typedef struct{
+    char buffer[TEMPLATE_LEN];
+    char keys[TEMPLATE_LEN];               // Clave de cada valor y el cierre del mensaje, concatenados
+    int key_len[TEMPLATE_MAX_FIELDS];
+    int tail_len;
+    int prefix_len;                        // -1 si la plantilla no es valida
+    int decimals[TEMPLATE_MAX_FIELDS];
+    int num_fields;
+    int cbor;
+}template_t;
+
+/**
+ * @brief Genera la plantilla de las metricas fields[0..num_fields-1]
+ * - JSON: {"id": <id>, "<key>": <valor>, "unidad": "<unit>"}
+ * - JSON combinado: {"id": <id>, "<key0>": <valor0>, "<key1>": <valor1>, ...}
+ * - CBOR (cbor != 0): el mismo mapa que en JSON sin la unidad
+ * @return 0, o -1 si la plantilla no cabe en TEMPLATE_LEN bytes
+ */
+int template_init(template_t* template, int cbor, const template_field_t* fields, int num_fields, int id);
+
+/**
+ * @brief Escribe los valores (en punto fijo) en la plantilla
+ * @return Longitud total del payload, 0 si la plantilla no es valida
+ */
+int template_fill(template_t* template, const int* values);
+
+/**
+ * @brief Como template_fill(), pero solo con las metricas cuyo bit esta a 1 en mask (bit i = metrica i);
+ * las demas no aparecen en el payload
+ * @return Longitud total del payload, 0 si la plantilla no es valida o mask no incluye ninguna metrica
+ */
+int template_fill_mask(template_t* template, const int* values, unsigned mask);
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ * @file app_stubs.c
+ * @brief Implementacion de los componentes de la placa del host.
+ */
+
+#include <pthread.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "app_stubs.h"
+#include "buttons.h"
+#include "leds.h"
+#include "sensors.h"
+#include "wifi.h"
+
+#define APP_PINS 40
+
+static pthread_mutex_t gLedLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gLedCond = PTHREAD_COND_INITIALIZER;
+static uint32_t gLedCount[APP_PINS];
+static int64_t gLedOnUs[APP_PINS];
+
+void wifi_init_sta(WifiCallback_t callback)
+{
+    callback(1);
+}
+
+led_err_t led_init()
+{
+    return LED_OK;
+}
+
+void led_on(uint32_t pin)
+{
+    int64_t now = esp_timer_get_time();
+
+    if(pin >= APP_PINS) return;
+    pthread_mutex_lock(&gLedLock);
+    gLedCount[pin]++;
+    gLedOnUs[pin] = now;
+    pthread_cond_broadcast(&gLedCond);
+    pthread_mutex_unlock(&gLedLock);
+}
+
+void led_off(uint32_t pin)
+{
+    (void) pin;
+}
+
+uint32_t app_led_count(uint32_t pin)
+{
+    uint32_t count;
+
+    pthread_mutex_lock(&gLedLock);
+    count = gLedCount[pin];
+    pthread_mutex_unlock(&gLedLock);
+    return count;
+}
+
+int64_t app_wait_led(uint32_t pin, uint32_t count, int timeout_ms)
+{
+    struct timespec deadline;
+    int64_t on_us = -1;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000){
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&gLedLock);
+    while(gLedCount[pin] <= count){
+        if(pthread_cond_timedwait(&gLedCond, &gLedLock, &deadline) != 0) break;
+    }
+    if(gLedCount[pin] > count) on_us = gLedOnUs[pin];
+    pthread_mutex_unlock(&gLedLock);
+    return on_us;
+}
+
+Button_err_t buttons_init(button_callback callback)
+{
+    (void) callback;
+    return BUTTON_OK;
+}
+
+eSensor_error sensors_init()
+{
+    return SENSOR_OK;
+}
+
+void sensors_on()
+{
+}
+
+void sensors_off()
+{
+}
+
+eSensor_error readSensors(sensor_data_t* data)
+{
+    (void) data;
+    return SENSOR_ERR_STATE;
+}
@@ -0,0 +1,24 @@
+#ifndef APP_STUBS_H
+#define APP_STUBS_H
+
+/**
+ * @file app_stubs.h
+ * @brief Componentes de la placa (Wi-Fi, LEDs, botones, sensores) para ejecutar main.c en el host
+ * @details Los LEDs de estado marcan el momento en que la FSM aplica un cambio: led_on() anota el
+ * instante y despierta a quien espera en app_wait_led().
+ */
+
+#include <stdint.h>
+
+/**
+ * @brief Numero de veces que se ha encendido el LED
+ */
+uint32_t app_led_count(uint32_t pin);
+
+/**
+ * @brief Espera a que el LED se encienda mas de count veces, como mucho timeout_ms
+ * @return esp_timer_get_time() del encendido, o -1 si no ha llegado
+ */
+int64_t app_wait_led(uint32_t pin, uint32_t count, int timeout_ms);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef BUTTONS_H
+#define BUTTONS_H
+
+/**
+ * @file buttons.h
+ * @brief Botones del host para test_latency: no hay pulsaciones
+ */
+
+#include <stdint.h>
+#include "board_definition.h"
+
+typedef enum{
+    BUTTON_OK,
+    BUTTON_ERR_INVALID
+}Button_err_t;
+
+typedef void(*button_callback)(uint32_t io_num);
+
+Button_err_t buttons_init(button_callback callback);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef LEDS_H
+#define LEDS_H
+
+/**
+ * @file leds.h
+ * @brief LEDs del host para test_latency: cada led_on() se anota con su instante (ver app_stubs.h)
+ */
+
+#include <stdint.h>
+#include "board_definition.h"
+
+typedef enum{
+    LED_OK,
+    LED_ERR_INVALID
+}led_err_t;
+
+led_err_t led_init();
+void led_on(uint32_t pin);
+void led_off(uint32_t pin);
+
+#endif
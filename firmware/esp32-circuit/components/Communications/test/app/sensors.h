@@ -0,0 +1,32 @@
+#ifndef SENSORS_H
+#define SENSORS_H
+
+/**
+ * @file sensors.h
+ * @brief Sensores del host para test_latency: la tarea de lectura no se arranca
+ */
+
+#include <stdint.h>
+#include "board_definition.h"
+
+typedef struct{
+    uint8_t light;
+    uint8_t temperature;
+    uint8_t temperature_dec;
+    uint8_t humidicity;
+    uint8_t humidicity_dec;
+}sensor_data_t;
+
+typedef enum{
+    SENSOR_OK,
+    SENSOR_ERR_INVALID,
+    SENSOR_ERR_STATE,
+    SENSOR_ERR_READ
+}eSensor_error;
+
+eSensor_error sensors_init();
+void sensors_on();
+void sensors_off();
+eSensor_error readSensors(sensor_data_t* data);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef WIFI_H
+#define WIFI_H
+
+/**
+ * @file wifi.h
+ * @brief Wi-Fi del host para test_latency: wifi_init_sta() informa de la conexion al momento
+ */
+
+typedef void(*WifiCallback_t)(int conectado);
+
+void wifi_init_sta(WifiCallback_t callback);
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ * @file batch_decode.c
+ * @brief Implementacion del decodificador de lotes del host.
+ */
+
+#include "batch.h"
+#include "batch_decode.h"
+
+void batch_reader_init(batch_reader_t* reader, const void* buf, size_t len)
+{
+    reader->p = (const uint8_t*)buf;
+    reader->end = reader->p + len;
+}
+
+int batch_get_varint(batch_reader_t* reader, uint64_t* value)
+{
+    const uint8_t* p = reader->p;
+    uint64_t result = 0;
+
+    for(int i = 0; i < 5 && p + i < reader->end; i++){
+        result |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+        if((p[i] & 0x80) == 0){
+            *value = result;
+            reader->p = p + i + 1;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int batch_get_uvarint(batch_reader_t* reader, uint32_t* value)
+{
+    batch_reader_t saved = *reader;
+    uint64_t result;
+
+    if(batch_get_varint(reader, &result) != 0) return -1;
+    if(result > UINT32_MAX){
+        *reader = saved;
+        return -1;
+    }
+    *value = (uint32_t)result;
+    return 0;
+}
+
+/**
+ * @brief Deshace el zig-zag: los pares son positivos y los impares negativos (en complemento a 2)
+ */
+static uint32_t batch_unzigzag(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+/**
+ * @brief Complemento a 2 de 32 bits a int32_t sin depender de la conversion de la implementacion
+ */
+static int32_t batch_to_int32(uint32_t value)
+{
+    return value <= INT32_MAX ? (int32_t)value : -1 - (int32_t)(UINT32_MAX - value);
+}
+
+int batch_get_svarint(batch_reader_t* reader, int32_t* value)
+{
+    uint32_t zigzag;
+
+    if(batch_get_uvarint(reader, &zigzag) != 0) return -1;
+    *value = batch_to_int32(batch_unzigzag(zigzag));
+    return 0;
+}
+
+int batch_get_header(batch_reader_t* reader, batch_header_t* header)
+{
+    batch_reader_t saved = *reader;
+
+    if(reader->p >= reader->end) return -1;
+    header->version = *reader->p++;
+    if(header->version != BATCH_VERSION ||
+       batch_get_uvarint(reader, &header->id) != 0 ||
+       batch_get_uvarint(reader, &header->age_ms) != 0 ||
+       batch_get_uvarint(reader, &header->period_ms) != 0 ||
+       batch_get_uvarint(reader, &header->count) != 0 ||
+       batch_get_uvarint(reader, &header->metrics) != 0){
+        *reader = saved;
+        return -1;
+    }
+    return 0;
+}
+
+int batch_get_series(batch_reader_t* reader, int count, int* decimals, int32_t* values)
+{
+    batch_reader_t saved = *reader;
+    uint32_t dec;
+    uint64_t token;
+    int i = 1;
+
+    if(batch_get_uvarint(reader, &dec) != 0 || dec > 9 || batch_get_svarint(reader, &values[0]) != 0){
+        *reader = saved;
+        return -1;
+    }
+    *decimals = (int)dec;
+
+    while(i < count){
+        if(batch_get_varint(reader, &token) != 0) break;
+        if(token & 1){
+            uint64_t zeros = token >> 1;
+            if(zeros == 0 || zeros > (uint64_t)(count - i)) break;
+            for(; zeros > 0; zeros--, i++) values[i] = values[i - 1];
+        }else{
+            // Suma modulo 2^32, la inversa de la resta del codificador
+            if((token >> 1) == 0 || (token >> 1) > UINT32_MAX) break;
+            values[i] = batch_to_int32((uint32_t)values[i - 1] + batch_unzigzag((uint32_t)(token >> 1)));
+            i++;
+        }
+    }
+    if(i < count){
+        *reader = saved;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef BATCH_DECODE_H
+#define BATCH_DECODE_H
+
+/**
+ * @file batch_decode.h
+ * @brief Decodificador de los lotes de telemetria (batch.h) para el lado del host (tests y herramientas)
+ * @details Cada funcion avanza el lector y devuelve 0, o -1 si el dato esta truncado o fuera de rango;
+ * en ese caso el lector no avanza.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct{
+    const uint8_t* p;
+    const uint8_t* end;
+}batch_reader_t;
+
+/**
+ * @brief Cabecera de un payload de ESP32/"id"/telemetry/batch (ver comm_batch_encode())
+ */
+typedef struct{
+    uint8_t version;
+    uint32_t id;
+    uint32_t age_ms;
+    uint32_t period_ms;
+    uint32_t count;
+    uint32_t metrics;
+}batch_header_t;
+
+void batch_reader_init(batch_reader_t* reader, const void* buf, size_t len);
+
+/**
+ * @brief Lee un varint de hasta 5 bytes (35 bits, lo que ocupa un token de serie)
+ */
+int batch_get_varint(batch_reader_t* reader, uint64_t* value);
+
+int batch_get_uvarint(batch_reader_t* reader, uint32_t* value);
+
+int batch_get_svarint(batch_reader_t* reader, int32_t* value);
+
+int batch_get_header(batch_reader_t* reader, batch_header_t* header);
+
+/**
+ * @brief Lee una serie de count valores; falla si los tokens no suman exactamente count - 1 deltas
+ */
+int batch_get_series(batch_reader_t* reader, int count, int* decimals, int32_t* values);
+
+#endif
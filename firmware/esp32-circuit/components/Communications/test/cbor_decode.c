@@ -0,0 +1,92 @@
+/**
+ * @file cbor_decode.c
+ * @brief Implementacion del decodificador CBOR del host.
+ */
+
+#include "cbor.h"
+#include "cbor_decode.h"
+
+void cbor_reader_init(cbor_reader_t* reader, const void* buf, size_t len)
+{
+    reader->p = (const uint8_t*)buf;
+    reader->end = reader->p + len;
+}
+
+int cbor_get_head(cbor_reader_t* reader, uint8_t* major, uint32_t* value)
+{
+    const uint8_t* p = reader->p;
+    int extra;
+
+    if(p >= reader->end) return -1;
+    *major = p[0] >> 5;
+    *value = p[0] & 0x1f;
+    if(*value < 24){
+        reader->p = p + 1;
+        return 0;
+    }
+    // 24, 25 y 26: el argumento ocupa 1, 2 o 4 bytes; 64 bits e indefinidos no se usan
+    if(*value > 26) return -1;
+    extra = 1 << (*value - 24);
+    if(reader->end - p < 1 + extra) return -1;
+
+    *value = 0;
+    for(int i = 1; i <= extra; i++){
+        *value = (*value << 8) | p[i];
+    }
+    reader->p = p + 1 + extra;
+    return 0;
+}
+
+int cbor_get_int(cbor_reader_t* reader, int32_t* value)
+{
+    cbor_reader_t saved = *reader;
+    uint8_t major;
+    uint32_t arg;
+
+    if(cbor_get_head(reader, &major, &arg) != 0) return -1;
+    if((major != CBOR_MAJOR_UINT && major != CBOR_MAJOR_NINT) || arg > INT32_MAX){
+        *reader = saved;
+        return -1;
+    }
+    // Los negativos se codifican como -1 - n
+    *value = major == CBOR_MAJOR_NINT ? -1 - (int32_t)arg : (int32_t)arg;
+    return 0;
+}
+
+int cbor_get_text(cbor_reader_t* reader, const char** text, uint32_t* len)
+{
+    cbor_reader_t saved = *reader;
+    uint8_t major;
+
+    if(cbor_get_head(reader, &major, len) != 0) return -1;
+    if(major != CBOR_MAJOR_TEXT || (uint32_t)(reader->end - reader->p) < *len){
+        *reader = saved;
+        return -1;
+    }
+    *text = (const char*)reader->p;
+    reader->p += *len;
+    return 0;
+}
+
+int cbor_get_fixed(cbor_reader_t* reader, int32_t* value, int* decimals)
+{
+    cbor_reader_t saved = *reader;
+    uint8_t major;
+    uint32_t arg;
+    int32_t exponent;
+
+    if(cbor_get_int(reader, value) == 0){
+        *decimals = 0;
+        return 0;
+    }
+    // tag 4, [exponente, mantisa]
+    if(cbor_get_head(reader, &major, &arg) != 0 || major != CBOR_MAJOR_TAG || arg != CBOR_TAG_DECIMAL_FRACTION ||
+       cbor_get_head(reader, &major, &arg) != 0 || major != CBOR_MAJOR_ARRAY || arg != 2 ||
+       cbor_get_int(reader, &exponent) != 0 || exponent > 0 || exponent < -9 ||
+       cbor_get_int(reader, value) != 0){
+        *reader = saved;
+        return -1;
+    }
+    *decimals = -exponent;
+    return 0;
+}
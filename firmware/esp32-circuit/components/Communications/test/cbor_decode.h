@@ -0,0 +1,39 @@
+#ifndef CBOR_DECODE_H
+#define CBOR_DECODE_H
+
+/**
+ * @file cbor_decode.h
+ * @brief Decodificador CBOR para el lado del host (tests y herramientas)
+ * @details Lee los mismos tipos que escribe cbor.h: enteros de 32 bits, textos, mapas, arrays y
+ * fracciones decimales (tag 4). Cada funcion avanza el lector y devuelve 0, o -1 si el dato esta
+ * truncado, no es del tipo esperado o no cabe en 32 bits; en ese caso el lector no avanza.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct{
+    const uint8_t* p;
+    const uint8_t* end;
+}cbor_reader_t;
+
+void cbor_reader_init(cbor_reader_t* reader, const void* buf, size_t len);
+
+/**
+ * @brief Lee la cabecera de un elemento: tipo mayor y argumento (valor, longitud o numero de items)
+ */
+int cbor_get_head(cbor_reader_t* reader, uint8_t* major, uint32_t* value);
+
+int cbor_get_int(cbor_reader_t* reader, int32_t* value);
+
+/**
+ * @brief Lee un texto; text apunta dentro del buffer y no termina en '\0'
+ */
+int cbor_get_text(cbor_reader_t* reader, const char** text, uint32_t* len);
+
+/**
+ * @brief Lee un valor en punto fijo: una fraccion decimal (tag 4) o un entero (decimals = 0)
+ */
+int cbor_get_fixed(cbor_reader_t* reader, int32_t* value, int* decimals);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+#include <stdint.h>
+
+// Solo los numeros de pin: en el host no hay GPIO
+typedef enum{
+    GPIO_NUM_14 = 14,
+    GPIO_NUM_17 = 17,
+    GPIO_NUM_19 = 19,
+    GPIO_NUM_21 = 21,
+    GPIO_NUM_22 = 22,
+    GPIO_NUM_23 = 23,
+    GPIO_NUM_25 = 25,
+    GPIO_NUM_26 = 26,
+    GPIO_NUM_27 = 27,
+}gpio_num_t;
+
+#endif
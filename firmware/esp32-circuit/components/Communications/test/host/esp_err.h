@@ -0,0 +1,21 @@
+#ifndef HOST_ESP_ERR_H
+#define HOST_ESP_ERR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+
+#define ESP_ERROR_CHECK(x) do{                                                  \
+        esp_err_t err_rc_ = (x);                                                \
+        if(err_rc_ != ESP_OK){                                                  \
+            fprintf(stderr, "%s:%d: ESP_ERROR_CHECK %d\n", __FILE__, __LINE__, err_rc_); \
+            abort();                                                            \
+        }                                                                       \
+    }while(0)
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+/**
+ * @brief Microsegundos desde el arranque del proceso (CLOCK_MONOTONIC)
+ */
+int64_t esp_timer_get_time(void);
+
+#endif
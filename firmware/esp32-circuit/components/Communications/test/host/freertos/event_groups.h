@@ -0,0 +1,9 @@
+#ifndef HOST_EVENT_GROUPS_H
+#define HOST_EVENT_GROUPS_H
+
+#include "freertos/FreeRTOS.h"
+
+#define BIT0 (1u << 0)
+#define BIT1 (1u << 1)
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef HOST_BROKER_H
+#define HOST_BROKER_H
+
+/**
+ * @file host_broker.h
+ * @brief Brokers MQTT en proceso para las pruebas en el host
+ * @details Cada broker se identifica por su URI, la misma que usa el cliente esp-mqtt del host para
+ * conectarse. Enruta los PUBLISH de los clientes a sus suscripciones y a los observadores de la prueba,
+ * guarda los mensajes retenidos, publica el Last Will cuando corta una conexion y resuelve los alias
+ * de topico de MQTT 5. Cuenta los bytes que ocuparia cada PUBLISH en el cable.
+ */
+
+#include <stdint.h>
+
+typedef struct{
+    uint32_t connects;        // Conexiones aceptadas
+    uint32_t refused;         // Conexiones rechazadas por version de protocolo
+    uint32_t publishes;       // PUBLISH recibidos de los clientes
+    uint64_t publish_bytes;   // Bytes de esos PUBLISH en el cable: cabecera fija, topico, propiedades y payload
+    uint32_t aliased;         // PUBLISH con el topico vacio, resuelto por su alias
+    uint32_t protocol_errors; // PUBLISH invalidos (alias desconocido o fuera de rango): el broker corta la conexion
+}host_broker_stats_t;
+
+/**
+ * @brief Observador de la prueba: recibe los mensajes que coinciden con su filtro, desde la tarea
+ * del cliente que publica. No debe llamar a las funciones de host_broker.h.
+ */
+typedef void (*host_broker_cb)(void* arg, const char* topic, const char* payload, int len, int retain);
+
+/**
+ * @brief Crea un broker
+ * @param mqtt5 0: solo MQTT 3.1.1, rechaza las conexiones MQTT 5 con el codigo 0x01
+ * @param alias_max Topic Alias Maximum que anuncia en el CONNACK de MQTT 5
+ */
+void host_broker_add(const char* uri, int mqtt5, int alias_max);
+
+/**
+ * @brief Arranca o para el broker. Al pararlo se cortan sus conexiones y rechaza las nuevas.
+ */
+void host_broker_set_up(const char* uri, int up);
+
+/**
+ * @brief Corta las conexiones sin parar el broker, como una caida de red: publica el Last Will de cada cliente
+ */
+void host_broker_drop_clients(const char* uri);
+
+/**
+ * @brief Tiempo que tarda el broker en aceptar una conexion (TCP, TLS y CONNACK)
+ */
+void host_broker_set_connect_delay(const char* uri, int ms);
+
+void host_broker_get_stats(const char* uri, host_broker_stats_t* stats);
+
+/**
+ * @brief Clientes conectados al broker ahora mismo
+ */
+int host_broker_clients(const char* uri);
+
+/**
+ * @brief Suscribe un observador. Recibe primero los retenidos que coinciden con el filtro.
+ */
+void host_broker_subscribe(const char* uri, const char* filter, host_broker_cb callback, void* arg);
+
+/**
+ * @brief Publica como un cliente externo (el dashboard o un operador)
+ */
+void host_broker_publish(const char* uri, const char* topic, const char* payload, int len, int retain);
+
+#endif
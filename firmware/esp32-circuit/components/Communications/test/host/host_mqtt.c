@@ -0,0 +1,740 @@
+/**
+ * @file host_mqtt.c
+ * @brief Cliente esp-mqtt y brokers MQTT en proceso para las pruebas en el host.
+ *
+ * Un unico cerrojo protege los brokers, las sesiones y las colas de cada cliente. Los manejadores de
+ * eventos y los observadores se llaman sin ese cerrojo, salvo los observadores de los PUBLISH, que se
+ * llaman desde host_broker_route() con el cerrojo tomado.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mqtt_client.h"
+#include "host_broker.h"
+
+#define HOST_MAX_BROKERS 4
+#define HOST_MAX_CLIENTS 4
+#define HOST_MAX_FILTERS 16
+#define HOST_MAX_OBSERVERS 16
+#define HOST_MAX_RETAINED 64
+#define HOST_MAX_ALIAS 64
+#define HOST_DEFAULT_RECONNECT_MS 10000
+#define HOST_DEFAULT_BUFFER 1024
+
+/**
+ * @brief Evento pendiente de entregar al manejador del cliente, o mensaje pendiente de enviar al broker
+ */
+typedef struct host_item{
+    esp_mqtt_event_id_t event_id;
+    int msg_id;
+    int qos;
+    int retain;
+    char* topic;
+    char* data;
+    int len;
+    struct host_item* next;
+}host_item_t;
+
+typedef struct{
+    host_item_t* head;
+    host_item_t* tail;
+}host_list_t;
+
+typedef struct{
+    char* topic;
+    char* payload;
+    int len;
+}host_retained_t;
+
+typedef struct{
+    char uri[128];
+    int mqtt5;
+    int alias_max;
+    int up;
+    int connect_delay_ms;
+    host_broker_stats_t stats;
+    host_retained_t retained[HOST_MAX_RETAINED];
+}host_broker_t;
+
+typedef struct{
+    int broker;
+    char* filter;
+    host_broker_cb callback;
+    void* arg;
+}host_observer_t;
+
+struct esp_mqtt_client{
+    esp_mqtt_client_config_t config;
+    char uri[128];
+    char will_topic[128];
+    char will_msg[128];
+    esp_event_handler_t handler;
+    void* handler_args;
+    pthread_t thread;
+    pthread_cond_t cond;
+    int started;
+    int broker;      // Broker de la conexion actual, -1 sin conexion
+    int dropped;     // El broker ha cortado la conexion
+    int protocol5;   // Version negociada en la conexion actual
+    int alias_max;   // Topic Alias Maximum del broker en la conexion actual
+    uint16_t alias;  // Propiedad de publicacion fijada con esp_mqtt5_client_set_publish_property()
+    int next_msg_id;
+    char* filters[HOST_MAX_FILTERS];
+    int num_filters;
+    char* aliases[HOST_MAX_ALIAS + 1]; // Topico de cada alias en la conexion actual (lado del broker)
+    host_list_t inbox;
+    host_list_t outbox;
+};
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static host_broker_t gBrokers[HOST_MAX_BROKERS];
+static int gBrokerCount;
+static struct esp_mqtt_client* gClients[HOST_MAX_CLIENTS];
+static int gClientCount;
+static host_observer_t gObservers[HOST_MAX_OBSERVERS];
+static int gObserverCount;
+
+static char* host_strndup(const char* str, int len)
+{
+    char* copy = malloc(len + 1);
+
+    if(copy == NULL) abort();
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static void host_list_push(host_list_t* list, host_item_t* item)
+{
+    item->next = NULL;
+    if(list->tail != NULL) list->tail->next = item;
+    else list->head = item;
+    list->tail = item;
+}
+
+static host_item_t* host_list_pop(host_list_t* list)
+{
+    host_item_t* item = list->head;
+
+    if(item != NULL){
+        list->head = item->next;
+        if(list->head == NULL) list->tail = NULL;
+    }
+    return item;
+}
+
+static void host_item_free(host_item_t* item)
+{
+    free(item->topic);
+    free(item->data);
+    free(item);
+}
+
+static host_item_t* host_item_new(esp_mqtt_event_id_t event_id, int msg_id, const char* topic, int topic_len,
+                                  const char* data, int len)
+{
+    host_item_t* item = calloc(1, sizeof(*item));
+
+    if(item == NULL) abort();
+    item->event_id = event_id;
+    item->msg_id = msg_id;
+    if(topic != NULL) item->topic = host_strndup(topic, topic_len);
+    if(data != NULL) item->data = host_strndup(data, len);
+    item->len = len;
+    return item;
+}
+
+static int host_broker_find(const char* uri)
+{
+    for(int i = 0; i < gBrokerCount; i++){
+        if(strcmp(gBrokers[i].uri, uri) == 0) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Coincidencia de un topico con un filtro MQTT ('+' un nivel, '#' el resto)
+ */
+static int host_topic_match(const char* filter, const char* topic)
+{
+    while(*filter != '\0'){
+        if(*filter == '#') return 1;
+        if(*filter == '+'){
+            while(*topic != '\0' && *topic != '/') topic++;
+            filter++;
+            continue;
+        }
+        if(*filter != *topic) return 0;
+        filter++;
+        topic++;
+    }
+    return *topic == '\0';
+}
+
+static int host_varint_len(int value)
+{
+    int len = 1;
+    while(value >= 128){
+        value /= 128;
+        len++;
+    }
+    return len;
+}
+
+/**
+ * @brief Bytes de un PUBLISH en el cable
+ */
+static int host_publish_size(int protocol5, int topic_len, int alias, int qos, int len)
+{
+    int remaining = 2 + topic_len + (qos > 0 ? 2 : 0) + len;
+
+    if(protocol5){
+        int properties = alias > 0 ? 3 : 0; // Identificador 0x23 y alias de 2 bytes
+        remaining += host_varint_len(properties) + properties;
+    }
+    return 1 + host_varint_len(remaining) + remaining;
+}
+
+static void host_retain(host_broker_t* broker, const char* topic, const char* payload, int len)
+{
+    host_retained_t* free_slot = NULL;
+
+    for(int i = 0; i < HOST_MAX_RETAINED; i++){
+        host_retained_t* retained = &broker->retained[i];
+        if(retained->topic == NULL){
+            if(free_slot == NULL) free_slot = retained;
+        }else if(strcmp(retained->topic, topic) == 0){
+            free(retained->payload);
+            if(len == 0){
+                free(retained->topic);
+                retained->topic = NULL;
+            }else{
+                retained->payload = host_strndup(payload, len);
+                retained->len = len;
+            }
+            return;
+        }
+    }
+    if(free_slot != NULL && len > 0){
+        free_slot->topic = host_strndup(topic, strlen(topic));
+        free_slot->payload = host_strndup(payload, len);
+        free_slot->len = len;
+    }
+}
+
+/**
+ * @brief Entrega un mensaje a las sesiones y observadores del broker. Con gLock tomado.
+ */
+static void host_broker_route(int index, const char* topic, const char* payload, int len, int retain)
+{
+    if(retain) host_retain(&gBrokers[index], topic, payload, len);
+
+    for(int i = 0; i < gClientCount; i++){
+        struct esp_mqtt_client* client = gClients[i];
+        if(client->broker != index || client->dropped) continue;
+        for(int f = 0; f < client->num_filters; f++){
+            if(!host_topic_match(client->filters[f], topic)) continue;
+            host_item_t* item = host_item_new(MQTT_EVENT_DATA, 0, topic, strlen(topic), payload, len);
+            host_list_push(&client->inbox, item);
+            pthread_cond_signal(&client->cond);
+            break;
+        }
+    }
+    for(int i = 0; i < gObserverCount; i++){
+        host_observer_t* observer = &gObservers[i];
+        if(observer->broker == index && host_topic_match(observer->filter, topic)){
+            observer->callback(observer->arg, topic, payload, len, 0);
+        }
+    }
+}
+
+/**
+ * @brief Corta la conexion del cliente y, si el broker sigue en marcha, publica su Last Will.
+ * Con gLock tomado.
+ */
+static void host_session_drop(struct esp_mqtt_client* client)
+{
+    int index = client->broker;
+
+    client->dropped = 1;
+    pthread_cond_signal(&client->cond);
+    if(gBrokers[index].up && client->will_topic[0] != '\0'){
+        host_broker_route(index, client->will_topic, client->will_msg, strlen(client->will_msg),
+                          client->config.session.last_will.retain);
+    }
+}
+
+/**
+ * @brief PUBLISH de un cliente conectado. Con gLock tomado.
+ * @return 0, o -1 si es un error de protocolo y el broker ha cortado la conexion
+ */
+static int host_broker_receive(struct esp_mqtt_client* client, const char* topic, const char* payload, int len,
+                               int qos, int retain)
+{
+    host_broker_t* broker = &gBrokers[client->broker];
+    int alias = client->protocol5 ? client->alias : 0;
+    int topic_len = strlen(topic);
+
+    broker->stats.publishes++;
+    broker->stats.publish_bytes += host_publish_size(client->protocol5, topic_len, alias, qos, len);
+
+    if(alias > 0){
+        if(alias > client->alias_max){
+            topic = NULL;
+        }else if(topic_len > 0){
+            free(client->aliases[alias]);
+            client->aliases[alias] = host_strndup(topic, topic_len);
+        }else{
+            topic = client->aliases[alias];
+            broker->stats.aliased++;
+        }
+    }else if(topic_len == 0){
+        topic = NULL;
+    }
+    if(topic == NULL){
+        broker->stats.protocol_errors++;
+        host_session_drop(client);
+        return -1;
+    }
+
+    host_broker_route(client->broker, topic, payload, len, retain);
+    return 0;
+}
+
+static void host_client_dispatch(struct esp_mqtt_client* client, esp_mqtt_event_t* event)
+{
+    event->client = client;
+    event->protocol_ver = client->protocol5 ? MQTT_PROTOCOL_V_5 : MQTT_PROTOCOL_V_3_1_1;
+    if(client->handler != NULL) client->handler(client->handler_args, "MQTT_EVENTS", event->event_id, event);
+}
+
+static void host_client_event(struct esp_mqtt_client* client, esp_mqtt_event_id_t event_id, int msg_id)
+{
+    esp_mqtt_event_t event = { .event_id = event_id, .msg_id = msg_id };
+    host_client_dispatch(client, &event);
+}
+
+/**
+ * @brief Entrega un MQTT_EVENT_DATA en fragmentos de buffer.size bytes
+ */
+static void host_client_data(struct esp_mqtt_client* client, host_item_t* item)
+{
+    int size = client->config.buffer.size > 0 ? client->config.buffer.size : HOST_DEFAULT_BUFFER;
+    int offset = 0;
+
+    do{
+        esp_mqtt_event_t event = {
+            .event_id = MQTT_EVENT_DATA,
+            .data = item->data + offset,
+            .data_len = item->len - offset < size ? item->len - offset : size,
+            .total_data_len = item->len,
+            .current_data_offset = offset,
+            .topic = offset == 0 ? item->topic : NULL,
+            .topic_len = offset == 0 ? (int) strlen(item->topic) : 0,
+        };
+        host_client_dispatch(client, &event);
+        offset += event.data_len;
+    }while(offset < item->len);
+}
+
+/**
+ * @brief Espera ms sin el cerrojo, como la pausa de reconexion de esp-mqtt
+ */
+static void host_client_wait(struct esp_mqtt_client* client, int ms)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000;
+    if(ts.tv_nsec >= 1000000000){
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    while(pthread_cond_timedwait(&client->cond, &gLock, &ts) != ETIMEDOUT);
+}
+
+/**
+ * @brief Intenta conectar con el broker de la URI actual. Con gLock tomado; lo suelta mientras espera.
+ * @return 0, o -1 con el error en error
+ */
+static int host_client_connect(struct esp_mqtt_client* client, esp_mqtt_error_codes_t* error)
+{
+    int want5 = client->config.session.protocol_ver == MQTT_PROTOCOL_V_5;
+    int index = host_broker_find(client->uri);
+    int delay = index >= 0 ? gBrokers[index].connect_delay_ms : 0;
+    host_broker_t* broker;
+
+    if(delay > 0){
+        pthread_mutex_unlock(&gLock);
+        vTaskDelay(pdMS_TO_TICKS(delay) > 0 ? pdMS_TO_TICKS(delay) : 1);
+        pthread_mutex_lock(&gLock);
+        index = host_broker_find(client->uri);
+    }
+
+    memset(error, 0, sizeof(*error));
+    if(index < 0 || !gBrokers[index].up){
+        error->error_type = MQTT_ERROR_TYPE_TCP_TRANSPORT;
+        return -1;
+    }
+    broker = &gBrokers[index];
+    if(want5 && !broker->mqtt5){
+        // Un broker 3.1.1 responde a un CONNECT de MQTT 5 con el codigo 0x01 de su version
+        broker->stats.refused++;
+        error->error_type = MQTT_ERROR_TYPE_CONNECTION_REFUSED;
+        error->connect_return_code = MQTT_CONNECTION_REFUSE_PROTOCOL;
+        return -1;
+    }
+
+    broker->stats.connects++;
+    client->broker = index;
+    client->dropped = 0;
+    client->protocol5 = want5;
+    client->alias_max = want5 ? broker->alias_max : 0;
+    for(int i = 0; i < client->num_filters; i++){
+        free(client->filters[i]);
+    }
+    client->num_filters = 0;
+    for(int i = 0; i <= HOST_MAX_ALIAS; i++){
+        free(client->aliases[i]);
+        client->aliases[i] = NULL;
+    }
+    return 0;
+}
+
+/**
+ * @brief Tarea del cliente: conexion, reconexion, outbox y entrega de eventos
+ */
+static void host_client_task(void* arg)
+{
+    struct esp_mqtt_client* client = arg;
+    host_item_t* item;
+
+    pthread_mutex_lock(&gLock);
+    for(;;){
+        if(client->broker < 0){
+            esp_mqtt_error_codes_t error;
+            pthread_mutex_unlock(&gLock);
+            host_client_event(client, MQTT_EVENT_BEFORE_CONNECT, 0);
+            pthread_mutex_lock(&gLock);
+
+            if(host_client_connect(client, &error) == 0){
+                pthread_mutex_unlock(&gLock);
+                host_client_event(client, MQTT_EVENT_CONNECTED, 0);
+                pthread_mutex_lock(&gLock);
+            }else{
+                esp_mqtt_event_t event = { .event_id = MQTT_EVENT_ERROR, .error_handle = &error };
+                pthread_mutex_unlock(&gLock);
+                host_client_dispatch(client, &event);
+                host_client_event(client, MQTT_EVENT_DISCONNECTED, 0);
+                pthread_mutex_lock(&gLock);
+                host_client_wait(client, client->config.network.reconnect_timeout_ms > 0 ?
+                                 client->config.network.reconnect_timeout_ms : HOST_DEFAULT_RECONNECT_MS);
+            }
+            continue;
+        }
+
+        if(client->dropped){
+            // Los QoS 0 del outbox se pierden con la conexion; los QoS 1 se reenvian al reconectar
+            host_list_t keep = {0};
+            while((item = host_list_pop(&client->outbox)) != NULL){
+                if(item->qos > 0) host_list_push(&keep, item);
+                else host_item_free(item);
+            }
+            client->outbox = keep;
+            while((item = host_list_pop(&client->inbox)) != NULL){
+                host_item_free(item);
+            }
+            client->broker = -1;
+            client->alias_max = 0;
+            pthread_mutex_unlock(&gLock);
+            host_client_event(client, MQTT_EVENT_DISCONNECTED, 0);
+            pthread_mutex_lock(&gLock);
+            host_client_wait(client, client->config.network.reconnect_timeout_ms > 0 ?
+                             client->config.network.reconnect_timeout_ms : HOST_DEFAULT_RECONNECT_MS);
+            continue;
+        }
+
+        if((item = host_list_pop(&client->outbox)) != NULL){
+            // esp_mqtt_client_enqueue() no usa las propiedades de publicacion: se envia sin alias
+            uint16_t alias = client->alias;
+            client->alias = 0;
+            int err = host_broker_receive(client, item->topic, item->data, item->len, item->qos, item->retain);
+            client->alias = alias;
+            if(err == 0 && item->qos > 0){
+                host_list_push(&client->inbox, host_item_new(MQTT_EVENT_PUBLISHED, item->msg_id, NULL, 0, NULL, 0));
+            }
+            host_item_free(item);
+            continue;
+        }
+
+        if((item = host_list_pop(&client->inbox)) != NULL){
+            pthread_mutex_unlock(&gLock);
+            if(item->event_id == MQTT_EVENT_DATA) host_client_data(client, item);
+            else host_client_event(client, item->event_id, item->msg_id);
+            host_item_free(item);
+            pthread_mutex_lock(&gLock);
+            continue;
+        }
+
+        pthread_cond_wait(&client->cond, &gLock);
+    }
+}
+
+static void host_client_configure(struct esp_mqtt_client* client, const esp_mqtt_client_config_t* config)
+{
+    client->config = *config;
+    if(config->broker.address.uri != NULL){
+        snprintf(client->uri, sizeof(client->uri), "%s", config->broker.address.uri);
+    }
+    client->will_topic[0] = '\0';
+    if(config->session.last_will.topic != NULL && config->session.last_will.msg != NULL){
+        snprintf(client->will_topic, sizeof(client->will_topic), "%s", config->session.last_will.topic);
+        snprintf(client->will_msg, sizeof(client->will_msg), "%s", config->session.last_will.msg);
+    }
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* config)
+{
+    struct esp_mqtt_client* client = calloc(1, sizeof(*client));
+    pthread_condattr_t attr;
+
+    if(client == NULL) return NULL;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&client->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    client->broker = -1;
+
+    pthread_mutex_lock(&gLock);
+    host_client_configure(client, config);
+    if(gClientCount < HOST_MAX_CLIENTS) gClients[gClientCount++] = client;
+    pthread_mutex_unlock(&gLock);
+    return client;
+}
+
+esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t* config)
+{
+    pthread_mutex_lock(&gLock);
+    host_client_configure(client, config);
+    pthread_mutex_unlock(&gLock);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_set_uri(esp_mqtt_client_handle_t client, const char* uri)
+{
+    pthread_mutex_lock(&gLock);
+    snprintf(client->uri, sizeof(client->uri), "%s", uri);
+    pthread_mutex_unlock(&gLock);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void* handler_args)
+{
+    (void) event;
+    client->handler = handler;
+    client->handler_args = handler_args;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if(client->started) return ESP_FAIL;
+    client->started = 1;
+    return xTaskCreate(host_client_task, "mqtt_task", 6144, client, 5, NULL) == pdPASS ? ESP_OK : ESP_FAIL;
+}
+
+static int host_next_msg_id(struct esp_mqtt_client* client)
+{
+    if(++client->next_msg_id > 0xffff) client->next_msg_id = 1;
+    return client->next_msg_id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char* topic, const char* data, int len,
+                            int qos, int retain)
+{
+    int msg_id;
+
+    if(len <= 0) len = data != NULL ? strlen(data) : 0;
+
+    pthread_mutex_lock(&gLock);
+    if(client->broker < 0 || client->dropped){
+        pthread_mutex_unlock(&gLock);
+        return -1;
+    }
+    msg_id = qos > 0 ? host_next_msg_id(client) : 0;
+    if(host_broker_receive(client, topic, data, len, qos, retain) != 0){
+        msg_id = -1;
+    }else if(qos > 0){
+        host_list_push(&client->inbox, host_item_new(MQTT_EVENT_PUBLISHED, msg_id, NULL, 0, NULL, 0));
+        pthread_cond_signal(&client->cond);
+    }
+    pthread_mutex_unlock(&gLock);
+    return msg_id;
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char* topic, const char* data, int len,
+                            int qos, int retain, bool store)
+{
+    host_item_t* item;
+
+    (void) store;
+    if(len <= 0) len = data != NULL ? strlen(data) : 0;
+
+    pthread_mutex_lock(&gLock);
+    item = host_item_new(MQTT_EVENT_PUBLISHED, qos > 0 ? host_next_msg_id(client) : 0, topic, strlen(topic), data, len);
+    item->qos = qos;
+    item->retain = retain;
+    host_list_push(&client->outbox, item);
+    pthread_cond_signal(&client->cond);
+    pthread_mutex_unlock(&gLock);
+    return item->msg_id;
+}
+
+int esp_mqtt_client_subscribe_multiple(esp_mqtt_client_handle_t client, const esp_mqtt_topic_t* topic_list,
+                                       int size)
+{
+    int msg_id;
+
+    pthread_mutex_lock(&gLock);
+    if(client->broker < 0 || client->dropped){
+        pthread_mutex_unlock(&gLock);
+        return -1;
+    }
+    msg_id = host_next_msg_id(client);
+    host_list_push(&client->inbox, host_item_new(MQTT_EVENT_SUBSCRIBED, msg_id, NULL, 0, NULL, 0));
+    for(int i = 0; i < size && client->num_filters < HOST_MAX_FILTERS; i++){
+        const char* filter = topic_list[i].filter;
+        client->filters[client->num_filters++] = host_strndup(filter, strlen(filter));
+        for(int r = 0; r < HOST_MAX_RETAINED; r++){
+            host_retained_t* retained = &gBrokers[client->broker].retained[r];
+            if(retained->topic != NULL && host_topic_match(filter, retained->topic)){
+                host_list_push(&client->inbox, host_item_new(MQTT_EVENT_DATA, 0, retained->topic,
+                                                             strlen(retained->topic), retained->payload, retained->len));
+            }
+        }
+    }
+    pthread_cond_signal(&client->cond);
+    pthread_mutex_unlock(&gLock);
+    return msg_id;
+}
+
+esp_err_t esp_mqtt5_client_set_publish_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_publish_property_config_t* property)
+{
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&gLock);
+    if(client->config.session.protocol_ver != MQTT_PROTOCOL_V_5){
+        err = ESP_FAIL;
+    }else if(property->topic_alias > client->alias_max){
+        err = ESP_FAIL; // Como esp-mqtt: no se admite un alias mayor que el Topic Alias Maximum del broker
+    }else{
+        client->alias = property->topic_alias;
+    }
+    pthread_mutex_unlock(&gLock);
+    return err;
+}
+
+void host_broker_add(const char* uri, int mqtt5, int alias_max)
+{
+    pthread_mutex_lock(&gLock);
+    if(gBrokerCount < HOST_MAX_BROKERS){
+        host_broker_t* broker = &gBrokers[gBrokerCount++];
+        snprintf(broker->uri, sizeof(broker->uri), "%s", uri);
+        broker->mqtt5 = mqtt5;
+        broker->alias_max = alias_max < HOST_MAX_ALIAS ? alias_max : HOST_MAX_ALIAS;
+        broker->up = 1;
+    }
+    pthread_mutex_unlock(&gLock);
+}
+
+void host_broker_set_up(const char* uri, int up)
+{
+    pthread_mutex_lock(&gLock);
+    int index = host_broker_find(uri);
+    if(index >= 0){
+        gBrokers[index].up = up;
+        for(int i = 0; !up && i < gClientCount; i++){
+            if(gClients[i]->broker == index && !gClients[i]->dropped) host_session_drop(gClients[i]);
+        }
+    }
+    pthread_mutex_unlock(&gLock);
+}
+
+void host_broker_drop_clients(const char* uri)
+{
+    pthread_mutex_lock(&gLock);
+    int index = host_broker_find(uri);
+    for(int i = 0; index >= 0 && i < gClientCount; i++){
+        if(gClients[i]->broker == index && !gClients[i]->dropped) host_session_drop(gClients[i]);
+    }
+    pthread_mutex_unlock(&gLock);
+}
+
+void host_broker_set_connect_delay(const char* uri, int ms)
+{
+    pthread_mutex_lock(&gLock);
+    int index = host_broker_find(uri);
+    if(index >= 0) gBrokers[index].connect_delay_ms = ms;
+    pthread_mutex_unlock(&gLock);
+}
+
+void host_broker_get_stats(const char* uri, host_broker_stats_t* stats)
+{
+    pthread_mutex_lock(&gLock);
+    int index = host_broker_find(uri);
+    if(index >= 0) *stats = gBrokers[index].stats;
+    else memset(stats, 0, sizeof(*stats));
+    pthread_mutex_unlock(&gLock);
+}
+
+int host_broker_clients(const char* uri)
+{
+    int count = 0;
+
+    pthread_mutex_lock(&gLock);
+    int index = host_broker_find(uri);
+    for(int i = 0; index >= 0 && i < gClientCount; i++){
+        if(gClients[i]->broker == index && !gClients[i]->dropped) count++;
+    }
+    pthread_mutex_unlock(&gLock);
+    return count;
+}
+
+void host_broker_subscribe(const char* uri, const char* filter, host_broker_cb callback, void* arg)
+{
+    pthread_mutex_lock(&gLock);
+    int index = host_broker_find(uri);
+    if(index >= 0 && gObserverCount < HOST_MAX_OBSERVERS){
+        host_observer_t* observer = &gObservers[gObserverCount++];
+        observer->broker = index;
+        observer->filter = host_strndup(filter, strlen(filter));
+        observer->callback = callback;
+        observer->arg = arg;
+        for(int r = 0; r < HOST_MAX_RETAINED; r++){
+            host_retained_t* retained = &gBrokers[index].retained[r];
+            if(retained->topic != NULL && host_topic_match(filter, retained->topic)){
+                callback(arg, retained->topic, retained->payload, retained->len, 1);
+            }
+        }
+    }
+    pthread_mutex_unlock(&gLock);
+}
+
+void host_broker_publish(const char* uri, const char* topic, const char* payload, int len, int retain)
+{
+    pthread_mutex_lock(&gLock);
+    int index = host_broker_find(uri);
+    if(index >= 0 && gBrokers[index].up) host_broker_route(index, topic, payload, len, retain);
+    pthread_mutex_unlock(&gLock);
+}
@@ -0,0 +1,321 @@
+/**
+ * @file host_rtos.c
+ * @brief FreeRTOS y servicios basicos de ESP-IDF sobre pthreads para las pruebas en el host.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host_rtos.h"
+
+#define HOST_RTOS_MAX_SKIP 4
+
+struct host_task{
+    pthread_t thread;
+    TaskFunction_t function;
+    void* parameters;
+    char name[32];
+    uint32_t notifications;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct host_queue{
+    uint8_t* items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct host_mutex{
+    pthread_mutex_t lock;
+};
+
+static pthread_mutex_t gCritical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static __thread struct host_task* gCurrent;
+static const char* gSkip[HOST_RTOS_MAX_SKIP];
+static int gSkipCount;
+
+void host_critical_enter(void)
+{
+    pthread_mutex_lock(&gCritical);
+}
+
+void host_critical_exit(void)
+{
+    pthread_mutex_unlock(&gCritical);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void host_log(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    static int max_level = -1;
+    va_list ap;
+
+    if(max_level < 0){
+        const char* env = getenv("HOST_LOG");
+        const char* found = env != NULL && env[0] != '\0' ? strchr(letters, env[0]) : NULL;
+        max_level = found != NULL ? (int)(found - letters) : ESP_LOG_WARN;
+    }
+    if((int) level > max_level) return;
+
+    va_start(ap, format);
+    fprintf(stderr, "%c (%lld) %s: ", letters[level], (long long)(esp_timer_get_time() / 1000), tag);
+    vfprintf(stderr, format, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+}
+
+/**
+ * @brief Momento absoluto (CLOCK_MONOTONIC) dentro de ticks ticks
+ */
+static struct timespec host_deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    uint64_t ms = (uint64_t) ticks * 1000 / configTICK_RATE_HZ;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (ms % 1000) * 1000000;
+    if(ts.tv_nsec >= 1000000000){
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+static void host_cond_init(pthread_cond_t* cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * @brief Espera en cond hasta deadline; con portMAX_DELAY sin limite
+ * @return 0, o ETIMEDOUT
+ */
+static int host_cond_wait(pthread_cond_t* cond, pthread_mutex_t* lock, TickType_t ticks,
+                          const struct timespec* deadline)
+{
+    if(ticks == portMAX_DELAY) return pthread_cond_wait(cond, lock);
+    return pthread_cond_timedwait(cond, lock, deadline);
+}
+
+static struct host_task* host_task_new(const char* name)
+{
+    struct host_task* task = calloc(1, sizeof(*task));
+
+    if(task == NULL) abort();
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    pthread_mutex_init(&task->lock, NULL);
+    host_cond_init(&task->cond);
+    return task;
+}
+
+static void* host_task_main(void* arg)
+{
+    struct host_task* task = arg;
+
+    gCurrent = task;
+    task->function(task->parameters);
+    return NULL;
+}
+
+void host_rtos_skip_task(const char* name)
+{
+    if(gSkipCount < HOST_RTOS_MAX_SKIP) gSkip[gSkipCount++] = name;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created)
+{
+    struct host_task* task = host_task_new(name);
+
+    (void) stack_depth;
+    (void) priority;
+    task->function = function;
+    task->parameters = parameters;
+    if(created != NULL) *created = task;
+
+    for(int i = 0; i < gSkipCount; i++){
+        if(strcmp(gSkip[i], name) == 0) return pdPASS;
+    }
+    if(pthread_create(&task->thread, NULL, host_task_main, task) != 0) return pdFALSE;
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if(task == NULL || task == gCurrent) pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    uint64_t us = (uint64_t) ticks * 1000000 / configTICK_RATE_HZ;
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+
+    while(nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() * configTICK_RATE_HZ / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // Los hilos que no son tareas (el de la prueba) reciben su handle la primera vez que lo piden
+    if(gCurrent == NULL){
+        gCurrent = host_task_new("host");
+        gCurrent->thread = pthread_self();
+    }
+    return gCurrent;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notifications++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct host_task* task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = host_deadline(ticks);
+    uint32_t value;
+
+    pthread_mutex_lock(&task->lock);
+    while(task->notifications == 0 && ticks > 0){
+        if(host_cond_wait(&task->cond, &task->lock, ticks, &deadline) == ETIMEDOUT) break;
+    }
+    value = task->notifications;
+    if(value > 0) task->notifications = clear_on_exit ? 0 : value - 1;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue* queue = calloc(1, sizeof(*queue));
+
+    if(queue == NULL || (queue->items = malloc((size_t) length * item_size)) == NULL){
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    host_cond_init(&queue->cond);
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    BaseType_t sent = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+    while(queue->count == queue->length && ticks > 0){
+        if(host_cond_wait(&queue->cond, &queue->lock, ticks, &deadline) == ETIMEDOUT) break;
+    }
+    if(queue->count < queue->length){
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + (size_t) tail * queue->item_size, item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&queue->cond);
+        sent = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return sent;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    BaseType_t received = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+    while(queue->count == 0 && ticks > 0){
+        if(host_cond_wait(&queue->cond, &queue->lock, ticks, &deadline) == ETIMEDOUT) break;
+    }
+    if(queue->count > 0){
+        memcpy(item, queue->items + (size_t) queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->cond);
+        received = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return received;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    UBaseType_t count;
+
+    pthread_mutex_lock(&queue->lock);
+    count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    struct host_mutex* mutex = calloc(1, sizeof(*mutex));
+
+    if(mutex != NULL) pthread_mutex_init(&mutex->lock, NULL);
+    return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks)
+{
+    struct timespec deadline;
+
+    if(ticks == portMAX_DELAY) return pthread_mutex_lock(&mutex->lock) == 0;
+    if(ticks == 0) return pthread_mutex_trylock(&mutex->lock) == 0;
+
+    // pthread_mutex_timedlock usa CLOCK_REALTIME
+    uint64_t ms = (uint64_t) ticks * 1000 / configTICK_RATE_HZ;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000){
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return pthread_mutex_timedlock(&mutex->lock, &deadline) == 0;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    return pthread_mutex_unlock(&mutex->lock) == 0;
+}
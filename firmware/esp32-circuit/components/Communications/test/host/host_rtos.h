@@ -0,0 +1,15 @@
+#ifndef HOST_RTOS_H
+#define HOST_RTOS_H
+
+/**
+ * @file host_rtos.h
+ * @brief Control de la FreeRTOS del host desde las pruebas
+ */
+
+/**
+ * @brief xTaskCreate() no arrancara las tareas con este nombre (hasta HOST_RTOS_MAX_SKIP)
+ * @details Para tareas que en el host solo gastarian CPU, como un bucle que no se bloquea nunca.
+ */
+void host_rtos_skip_task(const char* name);
+
+#endif
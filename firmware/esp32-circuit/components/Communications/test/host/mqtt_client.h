@@ -0,0 +1,145 @@
+#ifndef HOST_MQTT_CLIENT_H
+#define HOST_MQTT_CLIENT_H
+
+/**
+ * @file mqtt_client.h
+ * @brief Cliente esp-mqtt para las pruebas en el host, conectado a los brokers en proceso de host_broker.h
+ * @details Mantiene la interfaz y el orden de eventos de esp-mqtt: una tarea por cliente que conecta,
+ * reconecta tras network.reconnect_timeout_ms, vacia el outbox de esp_mqtt_client_enqueue() y entrega
+ * los eventos al manejador registrado. Los mensajes recibidos mas largos que buffer.size (1024 por
+ * defecto) llegan en varios MQTT_EVENT_DATA, como en esp-mqtt.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef const char* esp_event_base_t;
+typedef void (*esp_event_handler_t)(void* handler_args, esp_event_base_t base, int32_t event_id, void* event_data);
+
+#define ESP_EVENT_ANY_ID -1
+
+typedef struct esp_mqtt_client* esp_mqtt_client_handle_t;
+
+typedef enum{
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+    MQTT_EVENT_BEFORE_CONNECT,
+    MQTT_EVENT_DELETED,
+}esp_mqtt_event_id_t;
+
+typedef enum{
+    MQTT_ERROR_TYPE_NONE = 0,
+    MQTT_ERROR_TYPE_TCP_TRANSPORT,
+    MQTT_ERROR_TYPE_CONNECTION_REFUSED,
+}esp_mqtt_error_type_t;
+
+typedef enum{
+    MQTT_CONNECTION_ACCEPTED = 0,
+    MQTT_CONNECTION_REFUSE_PROTOCOL,
+    MQTT_CONNECTION_REFUSE_ID_REJECTED,
+    MQTT_CONNECTION_REFUSE_SERVER_UNAVAILABLE,
+    MQTT_CONNECTION_REFUSE_BAD_USERNAME,
+    MQTT_CONNECTION_REFUSE_NOT_AUTHORIZED,
+}esp_mqtt_connect_return_code_t;
+
+typedef enum{
+    MQTT_PROTOCOL_UNDEFINED = 0,
+    MQTT_PROTOCOL_V_3_1,
+    MQTT_PROTOCOL_V_3_1_1,
+    MQTT_PROTOCOL_V_5,
+}esp_mqtt_protocol_ver_t;
+
+typedef struct{
+    esp_mqtt_error_type_t error_type;
+    esp_mqtt_connect_return_code_t connect_return_code;
+}esp_mqtt_error_codes_t;
+
+typedef struct{
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    char* data;
+    int data_len;
+    int total_data_len;
+    int current_data_offset;
+    char* topic;
+    int topic_len;
+    int msg_id;
+    int session_present;
+    esp_mqtt_error_codes_t* error_handle;
+    bool retain;
+    int qos;
+    bool dup;
+    esp_mqtt_protocol_ver_t protocol_ver;
+}esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t* esp_mqtt_event_handle_t;
+
+typedef struct{
+    const char* filter;
+    int qos;
+}esp_mqtt_topic_t;
+
+typedef struct{
+    struct{
+        struct{
+            const char* uri;
+        }address;
+    }broker;
+    struct{
+        const char* username;
+        const char* client_id;
+        struct{
+            const char* password;
+        }authentication;
+    }credentials;
+    struct{
+        struct{
+            const char* topic;
+            const char* msg;
+            int msg_len;
+            int qos;
+            int retain;
+        }last_will;
+        esp_mqtt_protocol_ver_t protocol_ver;
+        int keepalive;
+    }session;
+    struct{
+        int reconnect_timeout_ms;
+        int timeout_ms;
+    }network;
+    struct{
+        int size;
+    }buffer;
+}esp_mqtt_client_config_t;
+
+typedef struct{
+    bool payload_format_indicator;
+    int64_t message_expiry_interval;
+    uint16_t topic_alias;
+    const char* response_topic;
+    const char* content_type;
+}esp_mqtt5_publish_property_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* config);
+esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t* config);
+esp_err_t esp_mqtt_client_set_uri(esp_mqtt_client_handle_t client, const char* uri);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void* handler_args);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char* topic, const char* data, int len,
+                            int qos, int retain);
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char* topic, const char* data, int len,
+                            int qos, int retain, bool store);
+int esp_mqtt_client_subscribe_multiple(esp_mqtt_client_handle_t client, const esp_mqtt_topic_t* topic_list,
+                                       int size);
+esp_err_t esp_mqtt5_client_set_publish_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_publish_property_config_t* property);
+
+#endif
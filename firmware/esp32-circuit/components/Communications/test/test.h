@@ -0,0 +1,37 @@
+#ifndef TEST_H
+#define TEST_H
+
+/**
+ * @file test.h
+ * @brief Comprobaciones minimas para los tests del host: cada fallo se imprime y se cuenta, y
+ * TEST_END() devuelve el codigo de salida que espera ctest.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+static int gTestFailures = 0;
+
+static inline void test_sleep_ms(int ms)
+{
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000 };
+    while(nanosleep(&ts, &ts) != 0);
+}
+
+#define CHECK(cond) do{ \
+        if(!(cond)){ \
+            fprintf(stderr, "%s:%d: fallo: %s\n", __FILE__, __LINE__, #cond); \
+            gTestFailures++; \
+        } \
+    }while(0)
+
+/**
+ * @brief Espera hasta que cond se cumpla, como mucho ms milisegundos (pruebas con tareas)
+ */
+#define WAIT_UNTIL(cond, ms) do{ \
+        for(int waited_ = 0; !(cond) && waited_ < (ms); waited_ += 10) test_sleep_ms(10); \
+    }while(0)
+
+#define TEST_END() (gTestFailures == 0 ? 0 : (fprintf(stderr, "%d fallos\n", gTestFailures), 1))
+
+#endif
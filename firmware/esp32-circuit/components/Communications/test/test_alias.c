@@ -0,0 +1,104 @@
+/**
+ * @file test_alias.c
+ * @brief Alias de topico de MQTT 5 y vuelta a MQTT 3.1.1, con los brokers en proceso de host_broker.h
+ * @details COMM_BROKER_URIS lista dos brokers: BROKER_V5 admite MQTT 5 con 10 alias y BROKER_V311 solo
+ * MQTT 3.1.1. Se publica la misma telemetria en los dos (el segundo tras parar el primero) y se
+ * comparan los bytes por mensaje en el cable. En el segundo, el CONNECT de MQTT 5 se rechaza con el
+ * codigo 0x01 y el modulo tiene que reconectar con 3.1.1 al mismo broker, sin alias.
+ */
+
+#include <string.h>
+#include "communications.h"
+#include "host_broker.h"
+#include "test.h"
+
+#define BROKER_V5 "mqtt://broker-v5:1883"
+#define BROKER_V311 "mqtt://broker-v311:1883"
+#define SAMPLES 20
+
+static volatile int gTelemetry[2]; // Mensajes de telemetria recibidos en cada broker
+
+static void on_telemetry(void* arg, const char* topic, const char* payload, int len, int retain)
+{
+    (void) topic;
+    (void) payload;
+    (void) len;
+    if(!retain) __atomic_add_fetch((volatile int*)arg, 1, __ATOMIC_SEQ_CST);
+}
+
+static void on_command(comm_message_t message)
+{
+    (void) message;
+}
+
+/**
+ * @brief Publica SAMPLES muestras en las que cambian las tres metricas
+ * @return Bytes por PUBLISH en el cable, o 0 si no han llegado todos
+ */
+static double send_samples(const char* uri, volatile int* received, host_broker_stats_t* delta)
+{
+    host_broker_stats_t before, after;
+    int expected = *received + 3 * SAMPLES;
+
+    host_broker_get_stats(uri, &before);
+    for(int i = 0; i < SAMPLES; i++){
+        comm_telemetry_t data = {
+            .humicity = 40, .humicity_dec = i % 10,
+            .temperature = 22, .temperature_dec = (i + 5) % 10,
+            .light = i % 2,
+        };
+        comm_send_telemetry(&data);
+        test_sleep_ms(20); // Que no se llene el carril de telemetria
+    }
+    WAIT_UNTIL(*received >= expected, 2000);
+    CHECK(*received == expected);
+    host_broker_get_stats(uri, &after);
+
+    delta->publishes = after.publishes - before.publishes;
+    delta->publish_bytes = after.publish_bytes - before.publish_bytes;
+    delta->aliased = after.aliased - before.aliased;
+    delta->protocol_errors = after.protocol_errors - before.protocol_errors;
+    return delta->publishes > 0 ? (double) delta->publish_bytes / delta->publishes : 0;
+}
+
+int main(void)
+{
+    host_broker_stats_t v5, v311, stats;
+    double bytes_v5, bytes_v311;
+
+    host_broker_add(BROKER_V5, 1, 10);
+    host_broker_add(BROKER_V311, 0, 0);
+    host_broker_subscribe(BROKER_V5, "ESP32/1/telemetry/#", on_telemetry, (void*) &gTelemetry[0]);
+    host_broker_subscribe(BROKER_V311, "ESP32/1/telemetry/#", on_telemetry, (void*) &gTelemetry[1]);
+
+    comm_init(on_command, "ESP32", 1);
+    WAIT_UNTIL(host_broker_clients(BROKER_V5) == 1, 2000);
+    CHECK(host_broker_clients(BROKER_V5) == 1);
+    test_sleep_ms(200); // Estado, diagnosticos de conexion y SUBACK
+
+    // MQTT 5: el primer mensaje de cada topico lo anuncia con su alias, el resto va con el topico vacio
+    bytes_v5 = send_samples(BROKER_V5, &gTelemetry[0], &v5);
+    CHECK(v5.publishes == 3 * SAMPLES);
+    CHECK(v5.aliased == 3 * SAMPLES - 3);
+    CHECK(v5.protocol_errors == 0);
+
+    // El broker MQTT 5 cae; el otro rechaza MQTT 5 y se reconecta con 3.1.1
+    host_broker_set_up(BROKER_V5, 0);
+    WAIT_UNTIL(host_broker_clients(BROKER_V311) == 1, 5000);
+    CHECK(host_broker_clients(BROKER_V311) == 1);
+    host_broker_get_stats(BROKER_V311, &stats);
+    CHECK(stats.refused == 1);
+    CHECK(stats.connects == 1);
+    test_sleep_ms(200);
+
+    bytes_v311 = send_samples(BROKER_V311, &gTelemetry[1], &v311);
+    CHECK(v311.publishes == 3 * SAMPLES);
+    CHECK(v311.aliased == 0);
+    CHECK(v311.protocol_errors == 0);
+
+    printf("{\"samples\": %d, \"mqtt5_alias_bytes_per_msg\": %.1f, \"mqtt311_bytes_per_msg\": %.1f, "
+           "\"saved_bytes_per_msg\": %.1f}\n", SAMPLES, bytes_v5, bytes_v311, bytes_v311 - bytes_v5);
+    // "ESP32/1/telemetry/humidicity" y similares: mas de 20 bytes de topico menos los 4 de propiedades
+    CHECK(bytes_v311 - bytes_v5 > 20);
+    return TEST_END();
+}
@@ -0,0 +1,219 @@
+/**
+ * @file test_batch.c
+ * @brief Ida y vuelta de la codificacion de lotes (batch.c) con el decodificador del host: limites de
+ * cada longitud de varint y del zig-zag, series con los extremos de int8_t e int32_t y series
+ * aleatorias con semilla fija.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "batch.h"
+#include "batch_decode.h"
+#include "test.h"
+
+#define MAX_COUNT 64
+
+// Limites de cada longitud de varint (1 a 5 bytes)
+static const uint32_t gUints[] = {
+    0, 127, 128, 16383, 16384, 2097151, 2097152, 268435455, 268435456, UINT32_MAX,
+};
+
+// Limites del zig-zag: cada pareja positivo/negativo cambia de longitud en el mismo punto
+static const int32_t gInts[] = {
+    0, -1, 1, 63, -64, 64, -65, 8191, -8192, 8192, -8193,
+    1048575, -1048576, 1048576, -1048577, 134217727, -134217728, 134217728, -134217729,
+    INT8_MAX, INT8_MIN, INT32_MAX, INT32_MIN,
+};
+
+static uint32_t gSeed = 12345;
+
+static uint32_t next_random(void)
+{
+    gSeed ^= gSeed << 13;
+    gSeed ^= gSeed >> 17;
+    gSeed ^= gSeed << 5;
+    return gSeed;
+}
+
+static int varint_len(uint64_t value)
+{
+    int len = 1;
+    while(value >= 0x80){
+        value >>= 7;
+        len++;
+    }
+    return len;
+}
+
+static void test_uvarint(void)
+{
+    uint8_t buf[8];
+    batch_reader_t reader;
+    uint32_t value;
+
+    for(size_t i = 0; i < sizeof(gUints) / sizeof(gUints[0]); i++){
+        int n = batch_put_uvarint(buf, gUints[i]);
+        CHECK(n == varint_len(gUints[i]));
+
+        batch_reader_init(&reader, buf, n);
+        CHECK(batch_get_uvarint(&reader, &value) == 0);
+        CHECK(value == gUints[i]);
+        CHECK(reader.p == reader.end);
+
+        for(int len = 0; len < n; len++){
+            batch_reader_init(&reader, buf, len);
+            CHECK(batch_get_uvarint(&reader, &value) == -1);
+            CHECK(reader.p == buf);
+        }
+    }
+
+    // Mas de 32 bits no es un uvarint, y mas de 5 bytes no es ningun varint
+    memcpy(buf, "\xff\xff\xff\xff\x1f", 5);
+    batch_reader_init(&reader, buf, 5);
+    CHECK(batch_get_uvarint(&reader, &value) == -1);
+    CHECK(reader.p == buf);
+    memcpy(buf, "\x80\x80\x80\x80\x80\x00", 6);
+    batch_reader_init(&reader, buf, 6);
+    CHECK(batch_get_uvarint(&reader, &value) == -1);
+}
+
+static void test_svarint(void)
+{
+    uint8_t buf[8];
+    batch_reader_t reader;
+    int32_t value;
+
+    for(size_t i = 0; i < sizeof(gInts) / sizeof(gInts[0]); i++){
+        int n = batch_put_svarint(buf, gInts[i]);
+        uint32_t zigzag = gInts[i] < 0 ? 2 * (uint32_t)(-1 - gInts[i]) + 1 : 2 * (uint32_t)gInts[i];
+        CHECK(n == varint_len(zigzag));
+
+        batch_reader_init(&reader, buf, n);
+        CHECK(batch_get_svarint(&reader, &value) == 0);
+        CHECK(value == gInts[i]);
+        CHECK(reader.p == reader.end);
+    }
+}
+
+/**
+ * @brief Codifica la serie, comprueba la cota de 5 bytes por varint y que se decodifica igual
+ * @return Longitud codificada
+ */
+static int check_series(const int32_t* values, int count, int decimals)
+{
+    uint8_t buf[5 * (2 + MAX_COUNT)];
+    int32_t decoded[MAX_COUNT];
+    batch_reader_t reader;
+    int dec = -1;
+
+    int n = batch_put_series(buf, decimals, values, count);
+    CHECK(n <= 5 * (count + 1) + 1);
+
+    batch_reader_init(&reader, buf, n);
+    CHECK(batch_get_series(&reader, count, &dec, decoded) == 0);
+    CHECK(reader.p == reader.end);
+    CHECK(dec == decimals);
+    CHECK(count == 0 || memcmp(decoded, values, count * sizeof(int32_t)) == 0);
+
+    // Truncada: error y el lector no avanza
+    if(n > 0){
+        batch_reader_init(&reader, buf, n - 1);
+        CHECK(batch_get_series(&reader, count, &dec, decoded) == -1);
+        CHECK(reader.p == buf);
+    }
+    return n;
+}
+
+static void test_series(void)
+{
+    int32_t values[MAX_COUNT];
+
+    // Sin cambios: decimals, valor inicial y un solo tramo de ceros
+    for(int i = 0; i < 30; i++) values[i] = 224;
+    CHECK(check_series(values, 30, 1) == 1 + 2 + 1);
+    CHECK(check_series(values, 1, 1) == 1 + 2);
+    values[0] = 0;
+    CHECK(check_series(values, 0, 0) == 2);
+
+    // Extremos de int8_t: deltas de +-255
+    for(int i = 0; i < 16; i++) values[i] = i % 2 ? INT8_MIN : INT8_MAX;
+    check_series(values, 16, 0);
+
+    // Extremos de int32_t: el delta INT32_MAX - INT32_MIN desborda int32_t y da la vuelta a -1
+    for(int i = 0; i < 16; i++) values[i] = i % 2 ? INT32_MIN : INT32_MAX;
+    CHECK(check_series(values, 16, 0) == 1 + 5 + 15);
+
+    // Delta INT32_MIN: zig-zag 0xffffffff, el token de 33 bits ocupa 5 bytes
+    values[0] = 0;
+    values[1] = INT32_MIN;
+    values[2] = 0;
+    CHECK(check_series(values, 3, 2) == 1 + 1 + 5 + 5);
+
+    // Tramos de ceros entre deltas, al principio y al final
+    int32_t mixed[] = { 5, 5, 5, 6, 6, 4, 4, 4, 4, -3, 100, 100 };
+    check_series(mixed, sizeof(mixed) / sizeof(mixed[0]), 0);
+}
+
+static void test_random_series(void)
+{
+    int32_t values[MAX_COUNT];
+
+    for(int round = 0; round < 20000; round++){
+        int count = next_random() % (MAX_COUNT + 1);
+        int kind = round % 4;
+        for(int i = 0; i < count; i++){
+            uint32_t r = next_random();
+            switch(kind){
+                case 0: // Cualquier int32_t
+                    values[i] = (int32_t)r;
+                    break;
+                case 1: // Extremos y limites del zig-zag
+                    values[i] = gInts[r % (sizeof(gInts) / sizeof(gInts[0]))];
+                    break;
+                case 2: // Un sensor: paseo aleatorio con tramos sin cambios
+                    values[i] = i == 0 ? (int32_t)(r % 1000) : values[i - 1] + (r % 4 == 0 ? (int32_t)(r % 7) - 3 : 0);
+                    break;
+                default: // int8_t
+                    values[i] = (int8_t)r;
+                    break;
+            }
+        }
+        check_series(values, count, next_random() % 10);
+    }
+}
+
+static void test_header(void)
+{
+    uint8_t buf[32];
+    batch_reader_t reader;
+    batch_header_t header;
+    int n = 0;
+
+    buf[n++] = BATCH_VERSION;
+    n += batch_put_uvarint(buf + n, 7);
+    n += batch_put_uvarint(buf + n, 61000);
+    n += batch_put_uvarint(buf + n, 2000);
+    n += batch_put_uvarint(buf + n, 30);
+    n += batch_put_uvarint(buf + n, 3);
+
+    batch_reader_init(&reader, buf, n);
+    CHECK(batch_get_header(&reader, &header) == 0);
+    CHECK(header.id == 7 && header.age_ms == 61000 && header.period_ms == 2000);
+    CHECK(header.count == 30 && header.metrics == 3);
+    CHECK(reader.p == reader.end);
+
+    buf[0] = BATCH_VERSION + 1;
+    batch_reader_init(&reader, buf, n);
+    CHECK(batch_get_header(&reader, &header) == -1);
+    CHECK(reader.p == buf);
+}
+
+int main(void)
+{
+    test_uvarint();
+    test_svarint();
+    test_series();
+    test_random_series();
+    test_header();
+    return TEST_END();
+}
@@ -0,0 +1,151 @@
+/**
+ * @file test_cbor.c
+ * @brief Ida y vuelta del codificador CBOR (cbor.c) con el decodificador del host, y decodificacion
+ * de los payloads de telemetria que generan las plantillas.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "cbor.h"
+#include "cbor_decode.h"
+#include "template.h"
+#include "test.h"
+
+// Limites de cada longitud de cabecera (1, 2, 3 y 5 bytes) a ambos lados del cero
+static const int32_t gInts[] = {
+    0, 1, 23, 24, 255, 256, 65535, 65536, INT32_MAX,
+    -1, -24, -25, -256, -257, -65536, -65537, INT32_MIN,
+};
+
+static void test_ints(void)
+{
+    uint8_t buf[8];
+    cbor_reader_t reader;
+    int32_t value;
+
+    for(size_t i = 0; i < sizeof(gInts) / sizeof(gInts[0]); i++){
+        int n = cbor_put_int(buf, gInts[i]);
+        uint32_t magnitude = gInts[i] < 0 ? (uint32_t)(-1 - gInts[i]) : (uint32_t)gInts[i];
+        CHECK(n == (magnitude < 24 ? 1 : magnitude <= 0xff ? 2 : magnitude <= 0xffff ? 3 : 5));
+
+        cbor_reader_init(&reader, buf, n);
+        CHECK(cbor_get_int(&reader, &value) == 0);
+        CHECK(value == gInts[i]);
+        CHECK(reader.p == reader.end);
+
+        // Truncado en cualquier punto: error y el lector no avanza
+        for(int len = 0; len < n; len++){
+            cbor_reader_init(&reader, buf, len);
+            CHECK(cbor_get_int(&reader, &value) == -1);
+            CHECK(reader.p == buf);
+        }
+    }
+}
+
+static void test_text(void)
+{
+    static const int lengths[] = {0, 1, 23, 24, 255, 256, 300};
+    char text[301];
+    uint8_t buf[320];
+    cbor_reader_t reader;
+    const char* decoded;
+    uint32_t len;
+    int32_t value;
+
+    for(size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++){
+        memset(text, 'a' + i, lengths[i]);
+        text[lengths[i]] = '\0';
+        int n = cbor_put_text(buf, text);
+
+        cbor_reader_init(&reader, buf, n);
+        CHECK(cbor_get_text(&reader, &decoded, &len) == 0);
+        CHECK(len == (uint32_t)lengths[i]);
+        CHECK(memcmp(decoded, text, len) == 0);
+        CHECK(reader.p == reader.end);
+
+        cbor_reader_init(&reader, buf, n - 1);
+        CHECK(lengths[i] == 0 || cbor_get_text(&reader, &decoded, &len) == -1);
+
+        // Un texto no es un entero
+        cbor_reader_init(&reader, buf, n);
+        CHECK(cbor_get_int(&reader, &value) == -1);
+    }
+}
+
+static void test_fixed(void)
+{
+    uint8_t buf[16];
+    cbor_reader_t reader;
+    int32_t value;
+    int decimals;
+
+    for(size_t i = 0; i < sizeof(gInts) / sizeof(gInts[0]); i++){
+        for(int d = 0; d <= 9; d++){
+            int n = cbor_put_fixed(buf, gInts[i], d);
+
+            // Con decimales: tag 4 (0xc4) y array de 2 (0x82) [-d, valor]
+            CHECK(d == 0 || (buf[0] == 0xc4 && buf[1] == 0x82 && buf[2] == 0x20 + d - 1));
+
+            cbor_reader_init(&reader, buf, n);
+            CHECK(cbor_get_fixed(&reader, &value, &decimals) == 0);
+            CHECK(value == gInts[i]);
+            CHECK(decimals == d);
+            CHECK(reader.p == reader.end);
+
+            cbor_reader_init(&reader, buf, n - 1);
+            CHECK(cbor_get_fixed(&reader, &value, &decimals) == -1);
+            CHECK(reader.p == buf);
+        }
+    }
+
+    // 23.4 -> 4(-1, 234) = c4 82 20 18 ea, como en el ejemplo de la RFC 8949
+    static const uint8_t expected[] = {0xc4, 0x82, 0x20, 0x18, 0xea};
+    CHECK(cbor_put_fixed(buf, 234, 1) == (int)sizeof(expected));
+    CHECK(memcmp(buf, expected, sizeof(expected)) == 0);
+}
+
+static void test_template(void)
+{
+    static const template_field_t fields[] = {
+        {"temperature", "Celsius", 1},
+        {"humidicity", "percentage", 1},
+        {"light", "bool", 0},
+    };
+    static const int values[] = {-55, 415, 1};
+    template_t json, cbor;
+    cbor_reader_t reader;
+    uint8_t major;
+    uint32_t count, len;
+    const char* key;
+    int32_t value;
+    int decimals;
+
+    CHECK(template_init(&json, 0, fields, 3, 7) == 0);
+    CHECK(template_init(&cbor, 1, fields, 3, 7) == 0);
+    int json_len = template_fill(&json, values);
+    int cbor_len = template_fill(&cbor, values);
+    CHECK(strcmp(json.buffer, "{\"id\": 7, \"temperature\": -5.5, \"humidicity\": 41.5, \"light\": 1}") == 0);
+    printf("telemetria combinada: %d bytes en JSON, %d en CBOR\n", json_len, cbor_len);
+
+    cbor_reader_init(&reader, cbor.buffer, cbor_len);
+    CHECK(cbor_get_head(&reader, &major, &count) == 0);
+    CHECK(major == CBOR_MAJOR_MAP && count == 4);
+    CHECK(cbor_get_text(&reader, &key, &len) == 0 && len == 2 && memcmp(key, "id", 2) == 0);
+    CHECK(cbor_get_int(&reader, &value) == 0 && value == 7);
+    for(int i = 0; i < 3; i++){
+        CHECK(cbor_get_text(&reader, &key, &len) == 0);
+        CHECK(len == strlen(fields[i].key) && memcmp(key, fields[i].key, len) == 0);
+        CHECK(cbor_get_fixed(&reader, &value, &decimals) == 0);
+        CHECK(value == values[i] && decimals == fields[i].decimals);
+    }
+    CHECK(reader.p == reader.end);
+}
+
+int main(void)
+{
+    test_ints();
+    test_text();
+    test_fixed();
+    test_template();
+    return TEST_END();
+}
@@ -0,0 +1,90 @@
+/**
+ * @file test_command.c
+ * @brief Payload de config/DELAY: solo se acepta un entero decimal no negativo
+ * @details Cada comando se publica en el broker en proceso y se comprueba el comm_message_t que llega al
+ * callback. Un campo de texto mas largo que JSON_STREAM_MAX_TOKEN en el mismo payload no debe impedir
+ * leer el retardo.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include "communications.h"
+#include "host_broker.h"
+#include "test.h"
+
+#define BROKER "mqtt://broker:1883"
+#define TOPIC_DELAY "ESP32/1/config/DELAY"
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static int gCount;                // Comandos DELAY recibidos
+static comm_message_t gLast;      // El ultimo de ellos
+
+static void on_command(comm_message_t message)
+{
+    if(message.message_type != DELAY) return;
+    pthread_mutex_lock(&gLock);
+    gLast = message;
+    gCount++;
+    pthread_mutex_unlock(&gLock);
+}
+
+static int command_count(void)
+{
+    pthread_mutex_lock(&gLock);
+    int count = gCount;
+    pthread_mutex_unlock(&gLock);
+    return count;
+}
+
+/**
+ * @brief Publica un DELAY y devuelve el mensaje que recibe el callback
+ */
+static comm_message_t send_delay(const char* payload)
+{
+    int count = command_count();
+    comm_message_t message;
+
+    host_broker_publish(BROKER, TOPIC_DELAY, payload, strlen(payload), 0);
+    WAIT_UNTIL(command_count() > count, 1000);
+    CHECK(command_count() == count + 1);
+    pthread_mutex_lock(&gLock);
+    message = gLast;
+    pthread_mutex_unlock(&gLock);
+    return message;
+}
+
+int main(void)
+{
+    comm_message_t message;
+
+    host_broker_add(BROKER, 1, 10);
+    comm_init(on_command, "ESP32", 1);
+    WAIT_UNTIL(host_broker_clients(BROKER) == 1, 2000);
+    CHECK(host_broker_clients(BROKER) == 1);
+    test_sleep_ms(100); // Suscripciones
+
+    message = send_delay("{\"delay\": 5000}");
+    CHECK(message.status == COMM_OK && message.value == 5000);
+
+    message = send_delay("{\"delay\": 0}");
+    CHECK(message.status == COMM_OK && message.value == 0);
+
+    // Numeros JSON validos que no son un retardo
+    CHECK(send_delay("{\"delay\": -1}").status == COMM_ERR_INVALID);
+    CHECK(send_delay("{\"delay\": 2.5}").status == COMM_ERR_INVALID);
+    CHECK(send_delay("{\"delay\": 5e3}").status == COMM_ERR_INVALID);
+    CHECK(send_delay("{\"delay\": 0x10}").status == COMM_ERR_INVALID);
+    CHECK(send_delay("{\"delay\": 99999999999}").status == COMM_ERR_INVALID);
+
+    // Ni otros tipos ni un payload sin retardo
+    CHECK(send_delay("{\"delay\": \"5000\"}").status == COMM_ERR_INVALID);
+    CHECK(send_delay("{\"delay\": 5000").status == COMM_ERR_INVALID);
+    CHECK(send_delay("{}").status == COMM_ERR_INVALID);
+
+    // Un texto largo que no se usa no invalida el payload
+    message = send_delay("{\"note\": \"cambiado desde el panel de control de la planta baja\", "
+                         "\"delay\": 3000}");
+    CHECK(message.status == COMM_OK && message.value == 3000);
+
+    return TEST_END();
+}
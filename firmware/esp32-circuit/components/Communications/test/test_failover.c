@@ -0,0 +1,128 @@
+/**
+ * @file test_failover.c
+ * @brief Cambio de broker con la lista COMM_BROKER_URIS, contra brokers en proceso (host_broker.h)
+ * @details Tres brokers con tiempos de conexion distintos: A lento, B rapido y C intermedio. Se comprueba
+ * que se prueban primero los que no se han medido, en el orden de la lista; que un broker que falla no
+ * se vuelve a elegir en COMM_BROKER_RETRY_MS (3 s aqui); que despues gana el de menor tiempo de conexion;
+ * que la telemetria sin broker se guarda y se publica en el broker al que se reconecta; y que no se
+ * vuelve a otro broker mientras la conexion sigue en pie.
+ */
+
+#include <string.h>
+#include "communications.h"
+#include "host_broker.h"
+#include "test.h"
+
+#define BROKER_A "mqtt://broker-a:1883"
+#define BROKER_B "mqtt://broker-b:1883"
+#define BROKER_C "mqtt://broker-c:1883"
+
+static const char* const gUris[] = { BROKER_A, BROKER_B, BROKER_C };
+static volatile int gDiagBroker[3]; // Mensajes en .../diag/broker de cada broker
+static volatile int gBacklog[3];    // Mensajes en .../telemetry/backlog de cada broker
+
+static void on_count(void* arg, const char* topic, const char* payload, int len, int retain)
+{
+    (void) topic;
+    (void) payload;
+    (void) len;
+    (void) retain;
+    __atomic_add_fetch((volatile int*)arg, 1, __ATOMIC_SEQ_CST);
+}
+
+static void on_command(comm_message_t message)
+{
+    (void) message;
+}
+
+static uint32_t current_broker(void)
+{
+    comm_link_stats_t stats;
+    comm_get_link_stats(&stats);
+    return stats.broker;
+}
+
+/**
+ * @brief Espera a que el cliente este conectado al broker index y devuelve los contadores
+ */
+static void wait_connected(int index, int ms, comm_link_stats_t* stats)
+{
+    WAIT_UNTIL(host_broker_clients(gUris[index]) == 1 && current_broker() == (uint32_t) index, ms);
+    CHECK(host_broker_clients(gUris[index]) == 1);
+    comm_get_link_stats(stats);
+    CHECK(stats->broker == (uint32_t) index);
+}
+
+int main(void)
+{
+    comm_link_stats_t stats;
+    comm_ring_stats_t ring;
+
+    for(int i = 0; i < 3; i++){
+        host_broker_add(gUris[i], 1, 10);
+        host_broker_subscribe(gUris[i], "ESP32/1/diag/broker", on_count, (void*) &gDiagBroker[i]);
+        host_broker_subscribe(gUris[i], "ESP32/1/telemetry/backlog", on_count, (void*) &gBacklog[i]);
+    }
+    host_broker_set_connect_delay(BROKER_A, 150);
+    host_broker_set_connect_delay(BROKER_B, 20);
+    host_broker_set_connect_delay(BROKER_C, 60);
+
+    // Sin medir todavia: el primero de la lista
+    comm_init(on_command, "ESP32", 1);
+    wait_connected(0, 2000, &stats);
+    CHECK(stats.failovers == 0);
+    CHECK(stats.connect_ms >= 150);
+    WAIT_UNTIL(gDiagBroker[0] == 1, 1000);
+    CHECK(gDiagBroker[0] == 1);
+
+    // Cae A: pasa al siguiente sin medir, B, tras COMM_RECONNECT_MS
+    host_broker_drop_clients(BROKER_A);
+    wait_connected(1, 3000, &stats);
+    CHECK(stats.failovers == 1);
+    CHECK(stats.failover_ms >= COMM_RECONNECT_MS && stats.failover_ms < COMM_RECONNECT_MS + 1000);
+    WAIT_UNTIL(gDiagBroker[1] == 1, 1000);
+    CHECK(gDiagBroker[1] == 1);
+
+    // Cae B: A fallo hace menos de COMM_BROKER_RETRY_MS, asi que va a C
+    host_broker_drop_clients(BROKER_B);
+    wait_connected(2, 3000, &stats);
+    CHECK(stats.failovers == 2);
+
+    // Pasado COMM_BROKER_RETRY_MS, A y B vuelven a contar: gana B, el de menor tiempo de conexion
+    test_sleep_ms(COMM_BROKER_RETRY_MS + 200);
+    host_broker_drop_clients(BROKER_C);
+    wait_connected(1, 3000, &stats);
+    CHECK(stats.failovers == 3);
+
+    // Sin ningun broker las muestras van al buffer y se publican al reconectar, aqui con C
+    for(int i = 0; i < 3; i++) host_broker_set_up(gUris[i], 0);
+    WAIT_UNTIL(host_broker_clients(BROKER_B) == 0, 1000);
+    test_sleep_ms(100);
+    for(int i = 0; i < 5; i++){
+        comm_telemetry_t data = { .temperature = 20 + i, .humicity = 40, .light = i % 2 };
+        comm_send_telemetry(&data);
+    }
+    comm_get_ring_stats(&ring);
+    CHECK(ring.pending == 5);
+    host_broker_set_up(BROKER_C, 1);
+    wait_connected(2, 3 * COMM_RECONNECT_MS + COMM_BROKER_RETRY_MS, &stats);
+    WAIT_UNTIL(gBacklog[2] >= 1, 2000);
+    CHECK(gBacklog[2] == 1);
+    comm_get_ring_stats(&ring);
+    CHECK(ring.replayed == 5 && ring.pending == 0);
+    CHECK(ring.buffered == ring.overflows + ring.replayed + ring.pending);
+
+    // Con la conexion en pie no vuelve a B aunque sea mas rapido
+    host_broker_set_up(BROKER_A, 1);
+    host_broker_set_up(BROKER_B, 1);
+    test_sleep_ms(2 * COMM_RECONNECT_MS);
+    CHECK(current_broker() == 2);
+    CHECK(host_broker_clients(BROKER_C) == 1);
+    CHECK(host_broker_clients(BROKER_A) == 0 && host_broker_clients(BROKER_B) == 0);
+
+    comm_get_link_stats(&stats);
+    printf("{\"failovers\": %u, \"failover_ms\": %u, \"failover_max_ms\": %u, \"connect_ms\": %u}\n",
+           (unsigned) stats.failovers, (unsigned) stats.failover_ms, (unsigned) stats.failover_max_ms,
+           (unsigned) stats.connect_ms);
+    return TEST_END();
+}
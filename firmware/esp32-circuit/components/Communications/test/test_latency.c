@@ -0,0 +1,136 @@
+/**
+ * @file test_latency.c
+ * @brief Latencia de los cambios de modo: main.c, Events y Communications en el host contra un broker
+ * en proceso (host_broker.h)
+ * @details Un operador publica ESP32/1/config/ON, CONFIG y SLEEP por turnos, de forma que cada comando
+ * cambia el estado. La latencia va desde la publicacion hasta que la FSM enciende el LED del nuevo estado
+ * (app_stubs.h). Antes de cada comando se espera un tiempo aleatorio de hasta 100 ms para no ir en fase
+ * con la tarea de la FSM. Despues se publican rafagas a ritmo fijo y se cuentan los cambios aplicados.
+ *
+ * Uso: test_latency [muestras]. Imprime una linea JSON con p50, p99, p999 y los cambios por segundo.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "app_stubs.h"
+#include "esp_timer.h"
+#include "events.h"
+#include "host_broker.h"
+#include "host_rtos.h"
+#include "test.h"
+
+#define BROKER "mqtt://broker:1883"
+#define DEFAULT_SAMPLES 1000
+#define BURST 100 // Comandos por rafaga
+
+void app_main(void);
+
+typedef struct{
+    const char* topic;
+    uint32_t led;
+}command_t;
+
+// En este orden cada comando cambia el estado
+static const command_t gCommands[] = {
+    { "ESP32/1/config/ON", PERFORMANCE_LED },
+    { "ESP32/1/config/CONFIG", CONFIG_LED },
+    { "ESP32/1/config/SLEEP", IDLE_LED },
+};
+
+static const int gRates[] = { 10, 50, 100, 500 }; // Comandos por segundo de cada rafaga
+
+static int compare_latency(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Percentil por el metodo del rango mas cercano sobre las latencias ordenadas
+ */
+static int64_t percentile(const int64_t* sorted, int n, int per_mille)
+{
+    int rank = (int)(((int64_t)n * per_mille + 999) / 1000);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static uint32_t state_leds(void)
+{
+    return app_led_count(PERFORMANCE_LED) + app_led_count(CONFIG_LED) + app_led_count(IDLE_LED);
+}
+
+int main(int argc, char** argv)
+{
+    int samples = argc > 1 ? atoi(argv[1]) : DEFAULT_SAMPLES;
+    int64_t* latency = calloc(samples > 0 ? samples : 1, sizeof(int64_t));
+    events_latency_t device;
+    int measured = 0;
+
+    srand(1);
+    host_broker_add(BROKER, 1, 10);
+    host_rtos_skip_task("Task read sensor"); // Sin sensores, su bucle no se bloquearia nunca
+    app_main();
+    WAIT_UNTIL(host_broker_clients(BROKER) == 1, 2000);
+    CHECK(host_broker_clients(BROKER) == 1);
+    CHECK(app_wait_led(IDLE_LED, 0, 1000) > 0); // La FSM arranca en idle
+    test_sleep_ms(200);
+
+    for(int i = 0; i < samples; i++){
+        const command_t* command = &gCommands[i % 3];
+        uint32_t count = app_led_count(command->led);
+        int64_t sent, applied;
+
+        test_sleep_ms(rand() % 100);
+        sent = esp_timer_get_time();
+        host_broker_publish(BROKER, command->topic, "", 0, 0);
+        applied = app_wait_led(command->led, count, 2000);
+        if(applied < 0) break;
+        latency[measured++] = applied - sent;
+    }
+    CHECK(measured == samples);
+
+    /*
+        El dispositivo anota una latencia por cambio aplicado, no por comando. La FSM enciende el LED
+        antes de anotarla, asi que se espera a que llegue la ultima.
+    */
+    WAIT_UNTIL((events_get_latency(&device), device.count >= (uint32_t) measured), 1000);
+    CHECK(device.count == (uint32_t) measured);
+    if(measured > 0){
+        // Repetir el ultimo comando no cambia el estado y no cuenta
+        host_broker_publish(BROKER, gCommands[(measured - 1) % 3].topic, "", 0, 0);
+        test_sleep_ms(300);
+        events_get_latency(&device);
+        CHECK(device.count == (uint32_t) measured);
+    }
+
+    qsort(latency, measured, sizeof(int64_t), compare_latency);
+    printf("{\"samples\": %d", measured);
+    if(measured > 0){
+        printf(", \"p50_us\": %lld, \"p99_us\": %lld, \"p999_us\": %lld, \"max_us\": %lld",
+               (long long) percentile(latency, measured, 500), (long long) percentile(latency, measured, 990),
+               (long long) percentile(latency, measured, 999), (long long) latency[measured - 1]);
+    }
+    printf(", \"throughput\": [");
+
+    // Rafagas: con una consulta periodica los cambios mas rapidos que el periodo se pierden
+    for(size_t r = 0; r < sizeof(gRates) / sizeof(gRates[0]); r++){
+        uint32_t before = state_leds();
+        int64_t start = esp_timer_get_time();
+        for(int i = 0; i < BURST; i++){
+            int64_t due = start + (int64_t) i * 1000000 / gRates[r];
+            int64_t now = esp_timer_get_time();
+            if(due > now) test_sleep_ms((int)((due - now + 999) / 1000));
+            host_broker_publish(BROKER, gCommands[i % 3].topic, "", 0, 0);
+        }
+        int64_t elapsed = esp_timer_get_time() - start;
+        test_sleep_ms(300); // Los ultimos comandos en vuelo
+        uint32_t applied = state_leds() - before;
+        printf("%s{\"rate\": %d, \"sent\": %d, \"applied\": %u, \"applied_per_s\": %.1f}", r > 0 ? ", " : "",
+               gRates[r], BURST, (unsigned) applied, applied * 1e6 / elapsed);
+        CHECK(applied > 0);
+    }
+    printf("]}\n");
+
+    free(latency);
+    return TEST_END();
+}
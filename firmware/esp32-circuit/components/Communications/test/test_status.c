@@ -0,0 +1,126 @@
+/**
+ * @file test_status.c
+ * @brief Mensaje de nacimiento y Last Will en .../status, en modo gateway con dos dispositivos
+ * @details El primero tiene el id mas largo (INT32_MIN) para que el Last Will ocupe todo su buffer.
+ * Mientras otra tarea cambia el estado del segundo dispositivo se cortan las conexiones, de forma que
+ * el manejador de CONNECTED publica el nacimiento a la vez: cada status tiene que ser uno completo.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "communications.h"
+#include "host_broker.h"
+#include "test.h"
+
+#define BROKER "mqtt://broker:1883"
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static char gFirst[128];   // Ultimo status del primer dispositivo
+static int gSecondCount;   // Status recibidos del segundo dispositivo
+static int gSecondInvalid; // Y cuantos no eran ninguno de los esperados
+static volatile int gWriting;
+
+static const char* const gSecondStates[] = {
+    "{\"id\": 2, \"online\": true, \"state\": \"performance\", \"delay\": 2000}",
+    "{\"id\": 2, \"online\": true, \"state\": \"configuration\", \"delay\": 5000}",
+};
+
+static void on_status(void* arg, const char* topic, const char* payload, int len, int retain)
+{
+    (void) arg;
+    (void) retain;
+    pthread_mutex_lock(&gLock);
+    if(strcmp(topic, "ESP32/2/status") == 0){
+        int valid = 0;
+        for(int i = 0; i < 2; i++){
+            valid |= len == (int) strlen(gSecondStates[i]) && memcmp(payload, gSecondStates[i], len) == 0;
+        }
+        gSecondCount++;
+        gSecondInvalid += !valid;
+    }else if(len < (int) sizeof(gFirst)){
+        memcpy(gFirst, payload, len);
+        gFirst[len] = '\0';
+    }
+    pthread_mutex_unlock(&gLock);
+}
+
+static int first_is(const char* expected)
+{
+    pthread_mutex_lock(&gLock);
+    int equal = strcmp(gFirst, expected) == 0;
+    pthread_mutex_unlock(&gLock);
+    return equal;
+}
+
+static int second_count(void)
+{
+    pthread_mutex_lock(&gLock);
+    int count = gSecondCount;
+    pthread_mutex_unlock(&gLock);
+    return count;
+}
+
+static void on_command(comm_message_t message)
+{
+    (void) message;
+}
+
+static void* write_states(void* arg)
+{
+    comm_device_t* device = arg;
+    for(int i = 0; gWriting; i++){
+        comm_device_send_status(device, i % 2 ? "configuration" : "performance", i % 2 ? 5000 : 2000);
+        test_sleep_ms(1);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    const char* online = "{\"id\": -2147483648, \"online\": true, \"state\": \"idle\", \"delay\": 2000}";
+    const char* offline = "{\"id\": -2147483648, \"online\": false}";
+    comm_device_t* first;
+    comm_device_t* second;
+    pthread_t writer;
+
+    host_broker_add(BROKER, 1, 10);
+    host_broker_subscribe(BROKER, "ESP32/+/status", on_status, NULL);
+
+    first = comm_device_add(on_command, "ESP32", INT32_MIN);
+    second = comm_device_add(on_command, "ESP32", 2);
+    CHECK(first != NULL && second != NULL);
+    CHECK(comm_device_send_status(first, "idle", 2000) == COMM_OK); // Se guarda para el nacimiento
+    CHECK(comm_device_send_status(second, "performance", 2000) == COMM_OK);
+    CHECK(comm_start() == COMM_OK);
+
+    WAIT_UNTIL(first_is(online) && second_count() >= 1, 2000);
+    CHECK(first_is(online));
+    CHECK(second_count() >= 1);
+
+    // Caida de red: el broker publica el Last Will completo del primer dispositivo
+    host_broker_drop_clients(BROKER);
+    WAIT_UNTIL(first_is(offline), 1000);
+    CHECK(first_is(offline));
+
+    // Reconexiones (cada COMM_RECONNECT_MS, hay dos URIs) con el estado cambiando a la vez
+    gWriting = 1;
+    pthread_create(&writer, NULL, write_states, second);
+    for(int i = 0; i < 3; i++){
+        WAIT_UNTIL(host_broker_clients(BROKER) == 1, 3000);
+        CHECK(host_broker_clients(BROKER) == 1);
+        test_sleep_ms(100);
+        host_broker_drop_clients(BROKER);
+    }
+    WAIT_UNTIL(host_broker_clients(BROKER) == 1, 3000);
+    WAIT_UNTIL(first_is(online), 1000);
+    CHECK(first_is(online));
+    gWriting = 0;
+    pthread_join(writer, NULL);
+
+    pthread_mutex_lock(&gLock);
+    printf("{\"second_status\": %d, \"invalid\": %d}\n", gSecondCount, gSecondInvalid);
+    CHECK(gSecondInvalid == 0);
+    pthread_mutex_unlock(&gLock);
+    return TEST_END();
+}
@@ -0,0 +1,96 @@
+/**
+ * @file test_template.c
+ * @brief Plantillas de telemetria: payload completo, solo las metricas pedidas en la mascara y el
+ * mapa CBOR con el numero de elementos corregido.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "cbor.h"
+#include "cbor_decode.h"
+#include "template.h"
+#include "test.h"
+
+static const template_field_t gFields[] = {
+    {"temperature", "Celsius", 1},
+    {"humidicity", "percentage", 1},
+    {"light", "bool", 0},
+};
+
+static const int gValues[] = {234, -5, 1};
+
+static void test_json(void)
+{
+    template_t single, combined;
+    int len;
+
+    CHECK(template_init(&single, 0, &gFields[0], 1, 1) == 0);
+    len = template_fill(&single, gValues);
+    CHECK(strcmp(single.buffer, "{\"id\": 1, \"temperature\": 23.4, \"unidad\": \"Celsius\"}") == 0);
+    CHECK(len == (int)strlen(single.buffer));
+
+    CHECK(template_init(&combined, 0, gFields, 3, 1) == 0);
+    template_fill(&combined, gValues);
+    CHECK(strcmp(combined.buffer, "{\"id\": 1, \"temperature\": 23.4, \"humidicity\": -0.5, \"light\": 1}") == 0);
+
+    len = template_fill_mask(&combined, gValues, 1u << 1);
+    CHECK(strcmp(combined.buffer, "{\"id\": 1, \"humidicity\": -0.5}") == 0);
+    CHECK(len == (int)strlen(combined.buffer));
+
+    template_fill_mask(&combined, gValues, (1u << 0) | (1u << 2));
+    CHECK(strcmp(combined.buffer, "{\"id\": 1, \"temperature\": 23.4, \"light\": 1}") == 0);
+
+    CHECK(template_fill_mask(&combined, gValues, 0) == 0);
+}
+
+static void test_cbor(void)
+{
+    template_t combined;
+    cbor_reader_t reader;
+    uint8_t major;
+    uint32_t count, len;
+    const char* key;
+    int32_t value;
+    int decimals;
+
+    CHECK(template_init(&combined, 1, gFields, 3, 1) == 0);
+    for(unsigned mask = 1; mask < 8; mask++){
+        int n = template_fill_mask(&combined, gValues, mask);
+        int expected = __builtin_popcount(mask);
+
+        cbor_reader_init(&reader, combined.buffer, n);
+        CHECK(cbor_get_head(&reader, &major, &count) == 0);
+        CHECK(major == CBOR_MAJOR_MAP && count == 1u + expected);
+        CHECK(cbor_get_text(&reader, &key, &len) == 0 && len == 2 && memcmp(key, "id", 2) == 0);
+        CHECK(cbor_get_int(&reader, &value) == 0 && value == 1);
+        for(int field = 0; field < 3; field++){
+            if(!(mask & (1u << field))) continue;
+            CHECK(cbor_get_text(&reader, &key, &len) == 0);
+            CHECK(len == strlen(gFields[field].key) && memcmp(key, gFields[field].key, len) == 0);
+            CHECK(cbor_get_fixed(&reader, &value, &decimals) == 0);
+            CHECK(value == gValues[field] && decimals == gFields[field].decimals);
+        }
+        CHECK(reader.p == reader.end);
+    }
+}
+
+static void test_too_long(void)
+{
+    static const template_field_t fields[] = {
+        {"una_clave_muy_larga_para_la_plantilla_de_telemetria", "", 0},
+        {"otra_clave_muy_larga_para_la_plantilla_de_telemetria", "", 0},
+    };
+    template_t combined;
+    int values[2] = {1, 2};
+
+    CHECK(template_init(&combined, 0, fields, 2, 1) == -1);
+    CHECK(template_fill(&combined, values) == 0);
+}
+
+int main(void)
+{
+    test_json();
+    test_cbor();
+    test_too_long();
+    return TEST_END();
+}
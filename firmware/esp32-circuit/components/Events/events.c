@@ -1,23 +1,31 @@
 #include "events.h"
 
 static gEventStruct gControlVariables;
+static events_latency_t gLatency;
+static portMUX_TYPE gLock = portMUX_INITIALIZER_UNLOCKED; // Protege command_us y gLatency
+
+const static char* TAG_EVENTS = "EVENTS";
+
+// Limite superior de cada intervalo del histograma de latencia, en us
+static const uint32_t gLatencyBounds[EVENTS_LATENCY_BUCKETS - 1] = {500, 1000, 2000, 5000, 10000, 20000, 50000};
 
 void events_init(){
     gControlVariables.wifi_connected = 0;
     gControlVariables.currentState = idle;
+    gControlVariables.command_us = 0;
     gControlVariables.queue_event_comm = xQueueCreate(10, sizeof(comm_message_t));
 }
 
 void callback_buttons(uint32_t io_num){
     if(io_num == OFF_BUTTON){
-        gControlVariables.currentState = idle;
+        events_set_state(idle, 0);
     }else{
         if(gControlVariables.currentState == performance){
-            gControlVariables.currentState = configuration;
+            events_set_state(configuration, 0);
         }else if(gControlVariables.currentState == configuration){
-            gControlVariables.currentState = performance;
+            events_set_state(performance, 0);
         }else{
-            gControlVariables.currentState = performance;
+            events_set_state(performance, 0);
         }
     }
 }
@@ -36,4 +44,41 @@ void callback_event_comm(comm_message_t message){
 
 const gEventStruct* get_control_variables(){
     return &gControlVariables;
-}
\ No newline at end of file
+}
+
+void events_set_state(State_t state, int64_t command_us){
+    taskENTER_CRITICAL(&gLock);
+    gControlVariables.command_us = command_us;
+    gControlVariables.currentState = state;
+    taskEXIT_CRITICAL(&gLock);
+}
+
+void events_state_applied(void){
+    int64_t now = esp_timer_get_time();
+    int64_t command_us;
+    uint32_t latency;
+    int bucket = 0;
+
+    taskENTER_CRITICAL(&gLock);
+    command_us = gControlVariables.command_us;
+    gControlVariables.command_us = 0;
+    if(command_us != 0){
+        latency = (uint32_t)(now - command_us);
+        while(bucket < EVENTS_LATENCY_BUCKETS - 1 && latency >= gLatencyBounds[bucket]) bucket++;
+        gLatency.count++;
+        gLatency.total_us += latency;
+        if(latency > gLatency.max_us) gLatency.max_us = latency;
+        gLatency.histogram[bucket]++;
+    }
+    taskEXIT_CRITICAL(&gLock);
+
+    if(command_us != 0){
+        ESP_LOGI(TAG_EVENTS, "Comando aplicado en %u us", (unsigned) latency);
+    }
+}
+
+void events_get_latency(events_latency_t* stats){
+    taskENTER_CRITICAL(&gLock);
+    *stats = gLatency;
+    taskEXIT_CRITICAL(&gLock);
+}
@@ -18,16 +18,44 @@ typedef enum
     idle
 }State_t;
 
+#define EVENTS_LATENCY_BUCKETS 8 // Intervalos del histograma: <0.5, <1, <2, <5, <10, <20, <50, >=50 ms
+
 typedef struct{
     QueueHandle_t queue_event_comm;
     int wifi_connected;
     State_t currentState;
+    int64_t command_us;     // Llegada del comando MQTT que provoco el cambio pendiente (0 si no lo provoco un comando)
 }gEventStruct;
 
+/**
+ * @brief Latencia desde que un comando MQTT llega al manejador hasta que la FSM aplica el nuevo estado
+ * @details Los percentiles se estiman con el histograma: p50 es el intervalo donde la suma acumulada
+ * llega a count / 2, p99 donde llega a count * 0.99.
+ */
+typedef struct{
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us; // La media es total_us / count
+    uint32_t histogram[EVENTS_LATENCY_BUCKETS];
+}events_latency_t;
+
 void events_init();
 void callback_buttons(uint32_t io_num);
 void callback_init_wifi(int conectado);
 void callback_event_comm(comm_message_t message);
 const gEventStruct* get_control_variables();
 
+/**
+ * @brief Cambia el estado; la tarea de la FSM lo aplica en su siguiente consulta
+ * @param command_us Campo received_us del comando que provoca el cambio, 0 si no viene de un comando
+ */
+void events_set_state(State_t state, int64_t command_us);
+
+/**
+ * @brief Llamada por la FSM tras aplicar un cambio de estado (no en cada consulta). Si el cambio lo provoco
+ * un comando anota su latencia.
+ */
+void events_state_applied(void);
+void events_get_latency(events_latency_t* stats);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,342 @@
+/*
+ * Host benchmark for Frozen.
+ *
+ * Runs each workload for at least FROZEN_BENCH_MIN_NS and prints a JSON
+ * document with, per workload, the time per operation, the input bytes
+ * processed per second and the heap allocations per operation (from
+ * json_heap_allocs()). On x86 the time stamp counter cycles per operation
+ * are reported too (null elsewhere); the TSC runs at a constant rate, so
+ * they are reference cycles rather than core cycles.
+ *
+ * s_telemetry is a per-metric payload as comm_send_telemetry() publishes it
+ * and s_command a config/DELAY command. s_config stands for a larger
+ * configuration document (nested objects, an array, escapes) and s_strings
+ * for long string values; the firmware does not handle either of them.
+ *
+ * The telemetry workloads build the three per-metric payloads of one
+ * sample, as comm_send_telemetry() does, with the precompiled templates of
+ * the Communications component and with the json_printf() calls they
+ * replace.
+ *
+ * Usage: frozen_bench [output.json]
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "frozen.h"
+#include "template.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef FROZEN_BENCH_MIN_NS
+#define FROZEN_BENCH_MIN_NS 200000000LL
+#endif
+
+struct bench {
+  const char *name;
+  int (*run)(void); /* One operation, returns a value to keep it alive */
+  int bytes;        /* Input bytes processed per operation */
+};
+
+static const char s_telemetry[] =
+    "{\"id\": 1, \"temperature\": 23.4, \"unidad\": \"Celsius\"}";
+
+static const char s_command[] = "{\"delay\": 5000}";
+
+static const char s_config[] =
+    "{\"device\": \"ESP32\", \"id\": 1, \"broker\": {\"uri\": "
+    "\"mqtt://192.168.1.10:1883\", \"user\": \"esp32\", \"keepalive\": 30}, "
+    "\"mode\": \"combined\", \"encoding\": \"json\", \"batch_size\": 8, "
+    "\"qos\": 1, \"fields\": [\"temperature\", \"humidicity\", \"light\"], "
+    "\"description\": \"Nodo de laboratorio con sensores de temperatura, "
+    "humedad y luz, alimentado por USB \\u00e1 \\\"planta baja\\\"\"}";
+
+/* Long string values: exercise the word-at-a-time string scanning */
+static const char s_strings[] =
+    "{\"description\": \"Nodo de laboratorio con sensores de temperatura, "
+    "humedad y luz, alimentado por USB en la planta baja del edificio\", "
+    "\"location\": \"Laboratorio de electronica, segunda mesa junto a la "
+    "ventana\", \"notes\": \"Revisar la calibracion del sensor de luz cada "
+    "seis meses y cambiar el DHT11 si la humedad se queda fija\"}";
+
+static volatile int s_sink;
+static char s_pretty[1024]; /* s_config pretty-printed: whitespace runs */
+static int s_pretty_len;
+static char s_out[512];
+
+static void noop_cb(void *data, const char *name, size_t name_len,
+                    const char *path, const struct json_token *token) {
+  (void) name;
+  (void) name_len;
+  (void) path;
+  (*(int *) data) += token->len;
+}
+
+static int walk_telemetry(void) {
+  int n = 0;
+  json_walk(s_telemetry, sizeof(s_telemetry) - 1, noop_cb, &n);
+  return n;
+}
+
+static int walk_config(void) {
+  int n = 0;
+  json_walk(s_config, sizeof(s_config) - 1, noop_cb, &n);
+  return n;
+}
+
+static int walk_strings(void) {
+  int n = 0;
+  json_walk(s_strings, sizeof(s_strings) - 1, noop_cb, &n);
+  return n;
+}
+
+static int walk_pretty(void) {
+  int n = 0;
+  json_walk(s_pretty, s_pretty_len, noop_cb, &n);
+  return n;
+}
+
+static int stream_config(void) {
+  struct json_stream s;
+  int n = 0, i;
+  json_stream_init(&s, noop_cb, &n);
+  /* Delivered in 32-byte chunks, like MQTT_EVENT_DATA fragments */
+  for (i = 0; i < (int) sizeof(s_config) - 1; i += 32) {
+    int len = (int) sizeof(s_config) - 1 - i;
+    json_stream_feed(&s, s_config + i, len < 32 ? len : 32);
+  }
+  json_stream_end(&s);
+  return n;
+}
+
+static int index_config(void) {
+  struct json_index_token tokens[32];
+  return json_index(s_config, sizeof(s_config) - 1, tokens, 32);
+}
+
+static int scanf_command(void) {
+  int delay = 0;
+  json_scanf(s_command, sizeof(s_command) - 1, "{delay: %d}", &delay);
+  return delay;
+}
+
+static int scanf_config_heap(void) {
+  char *uri = NULL;
+  int id = 0;
+  json_scanf(s_config, sizeof(s_config) - 1, "{id: %d, broker: {uri: %Q}}",
+             &id, &uri);
+  free(uri);
+  return id;
+}
+
+static int scanf_config_arena(void) {
+  char mem[128];
+  struct json_arena arena = JSON_ARENA(mem, sizeof(mem));
+  char *uri = NULL;
+  int id = 0;
+  json_scanf_arena(s_config, sizeof(s_config) - 1, &arena,
+                   "{id: %d, broker: {uri: %Q}}", &id, &uri);
+  return id + (uri != NULL);
+}
+
+static int printf_telemetry(void) {
+  struct json_out out = JSON_OUT_BUF(s_out, sizeof(s_out));
+  return json_printf(&out, "{id: %d, %Q: %.1D, unidad: %Q}", 1, "temperature",
+                     234, "Celsius");
+}
+
+/*
+ * Integers and fixed-point numbers through the internal formatter, and the
+ * same output through vsnprintf: a width of 1 or %f sends them there.
+ */
+static int printf_int(void) {
+  struct json_out out = JSON_OUT_BUF(s_out, sizeof(s_out));
+  return json_printf(&out, "[%d, %d, %d, %d]", -17, 2345, 1830, 2147483647);
+}
+
+static int printf_int_vsnprintf(void) {
+  struct json_out out = JSON_OUT_BUF(s_out, sizeof(s_out));
+  return json_printf(&out, "[%1d, %1d, %1d, %1d]", -17, 2345, 1830,
+                     2147483647);
+}
+
+static int printf_fixed(void) {
+  struct json_out out = JSON_OUT_BUF(s_out, sizeof(s_out));
+  return json_printf(&out, "[%.1D, %.2D]", 234, -1830);
+}
+
+static int printf_fixed_vsnprintf(void) {
+  struct json_out out = JSON_OUT_BUF(s_out, sizeof(s_out));
+  return json_printf(&out, "[%.1f, %.2f]", 23.4, -18.30);
+}
+
+static int printf_escape(void) {
+  struct json_out out = JSON_OUT_BUF(s_out, sizeof(s_out));
+  return json_escape(&out, s_config, sizeof(s_config) - 1);
+}
+
+static int setf_config(void) {
+  struct json_out out = JSON_OUT_BUF(s_out, sizeof(s_out));
+  return json_setf(s_config, sizeof(s_config) - 1, &out, ".broker.keepalive",
+                   "%d", 60);
+}
+
+static int prettify_telemetry(void) {
+  struct json_out out = JSON_OUT_BUF(s_out, sizeof(s_out));
+  return json_prettify(s_telemetry, sizeof(s_telemetry) - 1, &out);
+}
+
+static const template_field_t s_fields[] = {
+    {"temperature", "Celsius", 1},
+    {"humidicity", "percentage", 1},
+    {"light", "bool", 0},
+};
+#define NUM_FIELDS ((int) (sizeof(s_fields) / sizeof(s_fields[0])))
+
+static const int s_sample[NUM_FIELDS] = {234, 415, 1};
+static template_t s_json_templates[NUM_FIELDS];
+static template_t s_cbor_templates[NUM_FIELDS];
+
+static int telemetry_printf(void) {
+  int i, n = 0;
+  for (i = 0; i < NUM_FIELDS; i++) {
+    struct json_out out = JSON_OUT_BUF(s_out, sizeof(s_out));
+    if (s_fields[i].decimals > 0) {
+      n += json_printf(&out, "{id: %d, %Q: %d.%d, unidad: %Q}", 1,
+                       s_fields[i].key, s_sample[i] / 10, s_sample[i] % 10,
+                       s_fields[i].unit);
+    } else {
+      n += json_printf(&out, "{id: %d, %Q: %d, unidad: %Q}", 1,
+                       s_fields[i].key, s_sample[i], s_fields[i].unit);
+    }
+  }
+  return n;
+}
+
+static int telemetry_template(void) {
+  int i, n = 0;
+  for (i = 0; i < NUM_FIELDS; i++) {
+    n += template_fill(&s_json_templates[i], &s_sample[i]);
+  }
+  return n;
+}
+
+static int telemetry_template_cbor(void) {
+  int i, n = 0;
+  for (i = 0; i < NUM_FIELDS; i++) {
+    n += template_fill(&s_cbor_templates[i], &s_sample[i]);
+  }
+  return n;
+}
+
+static struct bench s_benches[] = {
+    {"walk/telemetry", walk_telemetry, sizeof(s_telemetry) - 1},
+    {"walk/config", walk_config, sizeof(s_config) - 1},
+    {"walk/strings", walk_strings, sizeof(s_strings) - 1},
+    {"walk/pretty", walk_pretty, 0}, /* bytes set in main() */
+    {"stream/config", stream_config, sizeof(s_config) - 1},
+    {"index/config", index_config, sizeof(s_config) - 1},
+    {"scanf/command", scanf_command, sizeof(s_command) - 1},
+    {"scanf/config_heap", scanf_config_heap, sizeof(s_config) - 1},
+    {"scanf/config_arena", scanf_config_arena, sizeof(s_config) - 1},
+    {"printf/telemetry", printf_telemetry, 0},
+    {"printf/int", printf_int, 0},
+    {"printf/int_vsnprintf", printf_int_vsnprintf, 0},
+    {"printf/fixed", printf_fixed, 0},
+    {"printf/fixed_vsnprintf", printf_fixed_vsnprintf, 0},
+    {"printf/escape", printf_escape, sizeof(s_config) - 1},
+    {"setf/config", setf_config, sizeof(s_config) - 1},
+    {"prettify/telemetry", prettify_telemetry, sizeof(s_telemetry) - 1},
+    {"telemetry/json_printf", telemetry_printf, 0},
+    {"telemetry/template", telemetry_template, 0},
+    {"telemetry/template_cbor", telemetry_template_cbor, 0},
+};
+
+static long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static unsigned long long now_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+int main(int argc, char *argv[]) {
+  FILE *fp = stdout;
+  size_t i;
+  int k;
+
+  for (k = 0; k < NUM_FIELDS; k++) {
+    template_init(&s_json_templates[k], 0, &s_fields[k], 1, 1);
+    template_init(&s_cbor_templates[k], 1, &s_fields[k], 1, 1);
+  }
+
+  {
+    struct json_out out = JSON_OUT_BUF(s_pretty, sizeof(s_pretty));
+    json_prettify(s_config, sizeof(s_config) - 1, &out);
+    s_pretty_len = (int) out.u.buf.len;
+    for (i = 0; i < sizeof(s_benches) / sizeof(s_benches[0]); i++) {
+      if (s_benches[i].run == walk_pretty) s_benches[i].bytes = s_pretty_len;
+    }
+  }
+
+  if (argc > 1 && (fp = fopen(argv[1], "w")) == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  fprintf(fp, "{\"swar\": %d, \"zero_heap\": %d, \"results\": [",
+#ifdef JSON_ENABLE_SWAR
+          JSON_ENABLE_SWAR,
+#else
+          1,
+#endif
+          JSON_ZERO_HEAP);
+  for (i = 0; i < sizeof(s_benches) / sizeof(s_benches[0]); i++) {
+    const struct bench *b = &s_benches[i];
+    long long iterations = 0, batch = 64, start, elapsed;
+    unsigned long long cycles;
+    unsigned long allocs;
+    double ns;
+
+    s_sink = b->run(); /* Warm up */
+    allocs = json_heap_allocs();
+    cycles = now_cycles();
+    start = now_ns();
+    do {
+      long long k;
+      for (k = 0; k < batch; k++) s_sink = b->run();
+      iterations += batch;
+      batch *= 2;
+      elapsed = now_ns() - start;
+    } while (elapsed < FROZEN_BENCH_MIN_NS);
+    cycles = now_cycles() - cycles;
+    allocs = json_heap_allocs() - allocs;
+
+    ns = (double) elapsed / (double) iterations;
+    fprintf(fp,
+            "%s\n  {\"name\": \"%s\", \"iterations\": %lld, \"ns_per_op\": "
+            "%.1f, \"bytes_per_s\": %.0f, \"allocs_per_op\": %.2f, "
+            "\"cycles_per_op\": ",
+            i > 0 ? "," : "", b->name, iterations, ns,
+            b->bytes > 0 ? b->bytes * 1e9 / ns : 0.0,
+            (double) allocs / (double) iterations);
+    if (cycles > 0) {
+      fprintf(fp, "%.0f}", (double) cycles / (double) iterations);
+    } else {
+      fprintf(fp, "null}");
+    }
+  }
+  fprintf(fp, "\n]}\n");
+
+  if (fp != stdout) fclose(fp);
+  return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * SWAR parity check for Frozen.
+ *
+ * Built twice, with and without JSON_ENABLE_SWAR, and run by ctest: both
+ * builds must print exactly the same lines. For every document of a corpus
+ * (telemetry and command payloads, a configuration document and edge cases,
+ * every prefix of them, single-byte mutations and pseudo-random byte soup)
+ * it prints the json_walk() return value and a hash of every callback (type,
+ * name, path and token position), plus a hash of json_escape() over the
+ * same bytes. The random inputs come from a fixed seed, so both builds see
+ * the same ones.
+ *
+ * Usage: frozen_parity > out.txt
+ */
+
+#include "frozen.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define PARITY_RANDOM_DOCS 20000
+#define PARITY_MAX_LEN 96
+
+static const char *s_corpus[] = {
+    "{\"id\": 1, \"temperature\": 23.4, \"unidad\": \"Celsius\"}",
+    "{\"delay\": 5000}",
+    "{\"heartbeat\": 60000, \"deadband\": {\"temperature\": 0.5, "
+    "\"humidicity\": 1, \"light\": 0}}",
+    "{\"nonce\": \"c0ffee-0042\"}",
+    "{\"device\": \"ESP32\", \"id\": 1, \"broker\": {\"uri\": "
+    "\"mqtt://192.168.1.10:1883\", \"keepalive\": 30}, \"fields\": "
+    "[\"temperatura\", \"humedad\", \"luz\"], \"description\": \"Nodo de "
+    "laboratorio \\u00e1 \\\"planta baja\\\" \\\\ fin\"}",
+    "{\n    \"a\": [\n        1,\n        -2.5e+3,\n        0x1F,\n        "
+    "true,\n        false,\n        null\n    ],\n\t\t\"b\": {}\n}",
+    "[12345678901234567890, 0.000000001, -0, 1E9, \"\", \"\\n\\t\\/\"]",
+    "{\"utf8\": \"\xc3\xa1\xe2\x82\xac\xf0\x9f\x98\x80 abcdefgh\"}",
+    "{\"ctl\": \"abc\x01" "def\", \"del\": \"x\x7fy\"}",
+    "{a: 1, b_2: [x, y]}",
+    "                                        {\"pad\":          1}       ",
+};
+
+static const char s_alphabet[] =
+    "{}[]\":,\\ \t\r\n0123456789.-+eExtrufalsn/u\x01\x1f\x7f\x80\xc3\xe2\xf0";
+
+static unsigned long s_seed = 12345;
+
+static unsigned long next_random(void) {
+  s_seed = s_seed * 1103515245UL + 12345UL;
+  return (s_seed >> 16) & 0x7fff;
+}
+
+static unsigned long hash_bytes(unsigned long h, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *) data;
+  size_t i;
+  for (i = 0; i < len; i++) h = (h ^ p[i]) * 16777619UL;
+  return h & 0xffffffffUL;
+}
+
+struct trace {
+  const char *doc;
+  unsigned long hash;
+  int calls;
+};
+
+static void trace_cb(void *data, const char *name, size_t name_len,
+                     const char *path, const struct json_token *token) {
+  struct trace *t = (struct trace *) data;
+  long pos[3];
+  pos[0] = token->type;
+  pos[1] = token->ptr != NULL ? (long) (token->ptr - t->doc) : -1;
+  pos[2] = token->len;
+  t->hash = hash_bytes(t->hash, pos, sizeof(pos));
+  if (name != NULL) t->hash = hash_bytes(t->hash, name, name_len);
+  t->hash = hash_bytes(t->hash, path, strlen(path));
+  t->calls++;
+}
+
+static int hash_printer(struct json_out *out, const char *str, size_t len) {
+  unsigned long *h = (unsigned long *) out->u.data;
+  *h = hash_bytes(*h, str, len);
+  return (int) len;
+}
+
+static void check(int n, const char *doc, int len) {
+  struct trace t;
+  struct json_out out;
+  unsigned long escape_hash = 2166136261UL;
+  int ret, escaped;
+
+  t.doc = doc;
+  t.hash = 2166136261UL;
+  t.calls = 0;
+  ret = json_walk(doc, len, trace_cb, &t);
+
+  out.printer = hash_printer;
+  out.u.data = &escape_hash;
+  escaped = json_escape(&out, doc, len);
+
+  printf("%d %d %d %d %08lx %d %08lx\n", n, len, ret, t.calls, t.hash,
+         escaped, escape_hash);
+}
+
+int main(void) {
+  char buf[PARITY_MAX_LEN + 256];
+  int n = 0, i, len, k;
+
+  for (i = 0; i < (int) (sizeof(s_corpus) / sizeof(s_corpus[0])); i++) {
+    const char *doc = s_corpus[i];
+    int doc_len = (int) strlen(doc);
+
+    /* The whole document and every prefix, i.e. every truncation point */
+    for (len = doc_len; len >= 0; len--) check(n++, doc, len);
+
+    /* Each byte replaced by each alphabet character */
+    for (k = 0; k < doc_len && doc_len < (int) sizeof(buf); k++) {
+      int c;
+      for (c = 0; s_alphabet[c] != '\0'; c++) {
+        memcpy(buf, doc, doc_len);
+        buf[k] = s_alphabet[c];
+        check(n++, buf, doc_len);
+      }
+    }
+  }
+
+  for (i = 0; i < PARITY_RANDOM_DOCS; i++) {
+    len = (int) (next_random() % PARITY_MAX_LEN);
+    for (k = 0; k < len; k++) {
+      buf[k] = s_alphabet[next_random() % (sizeof(s_alphabet) - 1)];
+    }
+    /* Half of them wrapped as a string value, to exercise string scanning */
+    if (i % 2 == 1 && len + 8 < (int) sizeof(buf)) {
+      memmove(buf + 7, buf, len);
+      memcpy(buf, "{\"k\": \"", 7);
+      buf[len + 7] = '"';
+      buf[len + 8] = '}';
+      len += 9;
+    }
+    check(n++, buf, len);
+  }
+
+  return 0;
+}
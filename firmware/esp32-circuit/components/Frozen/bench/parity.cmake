@@ -0,0 +1,17 @@
+# Runs the SWAR and the scalar builds of frozen_parity and fails if their
+# outputs differ. Invoked by ctest with -DSWAR=<exe> -DSCALAR=<exe>.
+execute_process(COMMAND ${SWAR} OUTPUT_VARIABLE swar_out RESULT_VARIABLE swar_rc)
+execute_process(COMMAND ${SCALAR} OUTPUT_VARIABLE scalar_out RESULT_VARIABLE scalar_rc)
+
+if(NOT swar_rc EQUAL 0 OR NOT scalar_rc EQUAL 0)
+  message(FATAL_ERROR "frozen_parity failed: swar ${swar_rc}, scalar ${scalar_rc}")
+endif()
+if(NOT swar_out STREQUAL scalar_out)
+  file(WRITE parity_swar.txt "${swar_out}")
+  file(WRITE parity_scalar.txt "${scalar_out}")
+  message(FATAL_ERROR "SWAR and scalar results differ, see parity_swar.txt and parity_scalar.txt")
+endif()
+
+string(REGEX MATCHALL "\n" lines "${swar_out}")
+list(LENGTH lines count)
+message(STATUS "${count} documents, identical results")
@@ -0,0 +1,199 @@
+/*
+ * Heap and arena tests for Frozen.
+ *
+ * Built twice, with and without JSON_ZERO_HEAP, and run by ctest. Checks
+ * that the arena and `_buf` functions never touch the heap, that arenas fail
+ * cleanly when exhausted, and that json_heap_allocs() counts exactly the
+ * allocations of the heap-based functions (none with JSON_ZERO_HEAP).
+ */
+
+#include "frozen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int s_failures = 0;
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #cond); \
+      s_failures++;                                                   \
+    }                                                                 \
+  } while (0)
+
+static void test_arena_alloc(void) {
+  char mem[16];
+  struct json_arena arena = JSON_ARENA(mem, sizeof(mem));
+  char *a, *b;
+
+  a = (char *) json_arena_alloc(&arena, 10);
+  CHECK(a == mem && arena.used == 10);
+  b = (char *) json_arena_alloc(&arena, 6);
+  CHECK(b == mem + 10 && arena.used == 16);
+
+  /* Exhausted: NULL and the arena is left as it was */
+  CHECK(json_arena_alloc(&arena, 1) == NULL && arena.used == 16);
+  CHECK(json_arena_alloc(&arena, (size_t) -1) == NULL && arena.used == 16);
+  CHECK(json_arena_alloc(&arena, 0) != NULL && arena.used == 16);
+
+  json_arena_reset(&arena);
+  CHECK(arena.used == 0);
+  CHECK(json_arena_alloc(&arena, 16) == mem);
+}
+
+static void test_arena_printf(void) {
+  char mem[16];
+  struct json_arena arena;
+  char *s;
+
+  /* "{"a": 123}" is 10 characters: fits with its NUL in 11 bytes */
+  json_arena_init(&arena, mem, 11);
+  s = json_arena_printf(&arena, "{a: %d}", 123);
+  CHECK(s == mem && strcmp(s, "{\"a\": 123}") == 0 && arena.used == 11);
+  CHECK(json_arena_printf(&arena, "%d", 1) == NULL && arena.used == 11);
+
+  /* One byte short: no room for the NUL */
+  json_arena_init(&arena, mem, 10);
+  CHECK(json_arena_printf(&arena, "{a: %d}", 123) == NULL && arena.used == 0);
+}
+
+static void test_scanf_arena(void) {
+  const char *doc = "{\"name\": \"sensor-01\", \"key\": \"YWJj\", \"hex\": \"fa01\"}";
+  char mem[32];
+  struct json_arena arena;
+  char *name = NULL, *key = NULL, *hex = NULL;
+  int key_len = 0, hex_len = 0;
+
+  json_arena_init(&arena, mem, sizeof(mem));
+  CHECK(json_scanf_arena(doc, strlen(doc), &arena, "{name: %Q, key: %V, hex: %H}",
+                         &name, &key, &key_len, &hex_len, &hex) == 3);
+  CHECK(name != NULL && strcmp(name, "sensor-01") == 0);
+  CHECK(key != NULL && key_len == 3 && memcmp(key, "abc", 3) == 0);
+  CHECK(hex != NULL && hex_len == 2 && (unsigned char) hex[0] == 0xfa &&
+        hex[1] == 0x01);
+  CHECK(name >= mem && name < mem + sizeof(mem));
+
+  /* Room for "sensor-01" but not for what follows */
+  json_arena_init(&arena, mem, 12);
+  name = key = hex = NULL;
+  CHECK(json_scanf_arena(doc, strlen(doc), &arena, "{name: %Q, key: %V, hex: %H}",
+                         &name, &key, &key_len, &hex_len, &hex) == 1);
+  CHECK(name == mem && arena.used == 10);
+  CHECK(key == NULL);
+
+  /* Too small for anything: no conversion and nothing used */
+  json_arena_init(&arena, mem, 4);
+  name = NULL;
+  CHECK(json_scanf_arena(doc, strlen(doc), &arena, "{name: %Q}", &name) == 0);
+  CHECK(name == NULL && arena.used == 0);
+}
+
+/* Same results with the caller's index, one too small for it, or none */
+static void test_scanf_index(void) {
+  const char *doc = "{\"id\": 7, \"cfg\": {\"delay\": 5000, \"unit\": \"ms\"}}";
+  static struct json_index_token tokens[8];
+  int sizes[] = {8, 2, 0}, i;
+
+  for (i = 0; i < 3; i++) {
+    char mem[8], *unit = NULL;
+    struct json_arena arena = JSON_ARENA(mem, sizeof(mem));
+    int id = 0, delay = 0;
+    CHECK(json_scanf_index(doc, strlen(doc), sizes[i] > 0 ? tokens : NULL,
+                           sizes[i], &arena,
+                           "{id: %d, cfg: {delay: %d, unit: %Q}}", &id,
+                           &delay, &unit) == 3);
+    CHECK(id == 7 && delay == 5000);
+    CHECK(unit == mem && strcmp(unit, "ms") == 0);
+  }
+}
+
+static void test_fread_buf(void) {
+  const char *path = "zero_heap_test.json";
+  const char *content = "{\"delay\": 5000}";
+  int len = (int) strlen(content);
+  char buf[32];
+  FILE *fp = fopen(path, "wb");
+
+  CHECK(fp != NULL);
+  if (fp == NULL) return;
+  fwrite(content, 1, len, fp);
+  fclose(fp);
+
+  CHECK(json_fread_buf(path, buf, sizeof(buf)) == len);
+  CHECK(strcmp(buf, content) == 0);
+  CHECK(json_fread_buf(path, buf, len + 1) == len);
+  CHECK(json_fread_buf(path, buf, len) == -1); /* No room for the NUL */
+  CHECK(json_fread_buf(path, buf, 0) == -1);
+  CHECK(json_fread_buf("does-not-exist.json", buf, sizeof(buf)) == -1);
+  remove(path);
+}
+
+/* None of the above may allocate, in either build */
+static void test_no_heap(void) {
+  unsigned long before = json_heap_allocs();
+  test_arena_alloc();
+  test_arena_printf();
+  test_scanf_arena();
+  test_scanf_index();
+  test_fread_buf();
+  CHECK(json_heap_allocs() == before);
+}
+
+static void test_heap_counter(void) {
+  const char *doc = "{\"name\": \"sensor-01\"}";
+  unsigned long before = json_heap_allocs();
+  char *s = json_asprintf("{a: %d}", 1), *name = NULL;
+  char out_buf[64];
+  struct json_out out = JSON_OUT_BUF(out_buf, sizeof(out_buf));
+  int n;
+
+#if JSON_ZERO_HEAP
+  (void) before;
+  CHECK(s == NULL);
+  CHECK(json_scanf(doc, strlen(doc), "{name: %Q}", &name) == 0 && name == NULL);
+
+  /* Long vsnprintf conversions print null instead of allocating */
+  n = json_printf(&out, "[%30s, %.30f, %5d]", "x", 1.0, 7);
+  CHECK(n == 19 && strcmp(out_buf, "[null, null,     7]") == 0);
+  CHECK(json_heap_allocs() == 0);
+#else
+  /* json_asprintf() grows its buffer once per printed piece */
+  CHECK(s != NULL && strcmp(s, "{\"a\": 1}") == 0);
+  CHECK(json_heap_allocs() > before);
+
+  before = json_heap_allocs();
+  CHECK(json_scanf(doc, strlen(doc), "{name: %Q}", &name) == 1 && name != NULL);
+  CHECK(json_heap_allocs() == before + 1);
+
+  n = json_printf(&out, "%30s", "x");
+  CHECK(n == 30 && strlen(out_buf) == 30);
+  CHECK(json_heap_allocs() == before + 2);
+
+  /* Fast paths and short vsnprintf conversions stay off the heap */
+  out.u.buf.len = 0;
+  json_printf(&out, "{a: %d, b: %.1D, c: %Q, d: %5d}", 1, 234, "x", 7);
+  CHECK(json_heap_allocs() == before + 2);
+#endif
+  free(s);
+  free(name);
+}
+
+/* A conversion too long for the internal format buffer prints nothing */
+static void test_long_conversion(void) {
+  unsigned long before = json_heap_allocs();
+  char out_buf[128];
+  struct json_out out = JSON_OUT_BUF(out_buf, sizeof(out_buf));
+  json_printf(&out, "[%0000000000000000000000005d, %d]", 1, 2);
+  CHECK(strcmp(out_buf, "[, 2]") == 0);
+  CHECK(json_heap_allocs() == before);
+}
+
+int main(void) {
+  test_no_heap();
+  test_heap_counter();
+  test_long_conversion();
+  if (s_failures > 0) fprintf(stderr, "%d failures\n", s_failures);
+  return s_failures == 0 ? 0 : 1;
+}
@@ -73,6 +73,26 @@ typedef unsigned _int64 uint64_t;
 #define JSON_ENABLE_ARRAY 1
 #endif
 
+/*
+ * Scan string bodies, whitespace runs and digit runs one machine word at a
+ * time (4 bytes on ESP32, 8 on 64-bit hosts) before falling back to the
+ * byte-by-byte path. Results are identical with and without it.
+ */
+#ifndef JSON_ENABLE_SWAR
+#define JSON_ENABLE_SWAR 1
+#endif
+
+/*
+ * An open object or array. The parser keeps these in `struct frozen` instead
+ * of recursing, so its stack use does not depend on the input.
+ */
+struct json_frame {
+  const char *start;             /* Opening bracket */
+  unsigned short path_len;       /* Path length to restore on close */
+  unsigned short member_path_len; /* Path length to restore after a member */
+  int index;                     /* Next array index, -1 for objects */
+};
+
 struct frozen {
   const char *end;
   const char *cur;
@@ -86,6 +106,10 @@ struct frozen {
   size_t path_len;
   void *callback_data;
   json_walk_callback_t callback;
+
+  /* Open objects and arrays, innermost last */
+  struct json_frame stack[JSON_MAX_NESTING];
+  int depth;
 };
 
 struct fstate {
@@ -128,9 +152,6 @@ static void json_truncate_path(struct frozen *f, size_t len) {
   f->path[len] = '\0';
 }
 
-static int json_parse_object(struct frozen *f);
-static int json_parse_value(struct frozen *f);
-
 #define EXPECT(cond, err_code)      \
   do {                              \
     if (!(cond)) return (err_code); \
@@ -152,10 +173,89 @@ static int json_isspace(int ch) {
   return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
 }
 
+static int json_isdigit(int ch) {
+  return ch >= '0' && ch <= '9';
+}
+
+#if JSON_ENABLE_SWAR
+typedef size_t json_word_t;
+
+#define JSON_WORD_SIZE ((int) sizeof(json_word_t))
+#define JSON_WORD_ONES ((json_word_t) -1 / 0xff) /* 0x0101...01 */
+#define JSON_WORD_HIGHS (JSON_WORD_ONES * 0x80)  /* 0x8080...80 */
+
+static json_word_t json_load_word(const char *p) {
+  json_word_t w;
+  memcpy(&w, p, sizeof(w)); /* Unaligned-safe, compiles to a single load */
+  return w;
+}
+
+/* Set the high bit of every byte of `w` that is zero, clear all others */
+static json_word_t json_word_zero_bytes(json_word_t w) {
+  return ~(((w & ~JSON_WORD_HIGHS) + ~JSON_WORD_HIGHS) | w) & JSON_WORD_HIGHS;
+}
+
+/* Non-zero if some byte of `w` is less than `n`, n <= 128 */
+static json_word_t json_word_has_less(json_word_t w, int n) {
+  return (w - JSON_WORD_ONES * n) & ~w & JSON_WORD_HIGHS;
+}
+
+/* Non-zero if some byte of `w` is greater than `n`, n <= 127 */
+static json_word_t json_word_has_more(json_word_t w, int n) {
+  return ((w + JSON_WORD_ONES * (127 - n)) | w) & JSON_WORD_HIGHS;
+}
+
+/* Non-zero if some byte of `w` equals `ch` */
+static json_word_t json_word_has_byte(json_word_t w, int ch) {
+  return json_word_has_less(w ^ (JSON_WORD_ONES * ch), 1);
+}
+
+/*
+ * True if every byte of `w` is a plain printable ASCII string character,
+ * i.e. one that json_parse_string() would accept and skip as-is.
+ */
+static int json_word_is_plain(json_word_t w) {
+  return !((w & JSON_WORD_HIGHS) | json_word_has_less(w, 32) |
+           json_word_has_byte(w, '"') | json_word_has_byte(w, '\\'));
+}
+
+static int json_word_is_space(json_word_t w) {
+  json_word_t m = json_word_zero_bytes(w ^ (JSON_WORD_ONES * ' ')) |
+                  json_word_zero_bytes(w ^ (JSON_WORD_ONES * '\n')) |
+                  json_word_zero_bytes(w ^ (JSON_WORD_ONES * '\r')) |
+                  json_word_zero_bytes(w ^ (JSON_WORD_ONES * '\t'));
+  return m == JSON_WORD_HIGHS;
+}
+
+static int json_word_is_digits(json_word_t w) {
+  return !(json_word_has_less(w, '0') | json_word_has_more(w, '9'));
+}
+#endif /* JSON_ENABLE_SWAR */
+
 static void json_skip_whitespaces(struct frozen *f) {
+#if JSON_ENABLE_SWAR
+  /* Compact JSON has at most one space between tokens: only go wide on runs */
+  if (json_left(f) > JSON_WORD_SIZE && json_isspace(f->cur[0]) &&
+      json_isspace(f->cur[1])) {
+    while (json_left(f) >= JSON_WORD_SIZE &&
+           json_word_is_space(json_load_word(f->cur))) {
+      f->cur += JSON_WORD_SIZE;
+    }
+  }
+#endif
   while (f->cur < f->end && json_isspace(*f->cur)) f->cur++;
 }
 
+static void json_skip_digits(struct frozen *f) {
+#if JSON_ENABLE_SWAR
+  while (json_left(f) >= JSON_WORD_SIZE &&
+         json_word_is_digits(json_load_word(f->cur))) {
+    f->cur += JSON_WORD_SIZE;
+  }
+#endif
+  while (f->cur < f->end && json_isdigit(f->cur[0])) f->cur++;
+}
+
 static int json_cur(struct frozen *f) {
   json_skip_whitespaces(f);
   return f->cur >= f->end ? END_OF_STRING : *(unsigned char *) f->cur;
@@ -174,16 +274,13 @@ static int json_isalpha(int ch) {
   return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
 }
 
-static int json_isdigit(int ch) {
-  return ch >= '0' && ch <= '9';
-}
-
 static int json_isxdigit(int ch) {
   return json_isdigit(ch) || (ch >= 'a' && ch <= 'f') ||
          (ch >= 'A' && ch <= 'F');
 }
 
 static int json_get_escape_len(const char *s, int len) {
+  if (len < 2) return JSON_STRING_INCOMPLETE; /* Nothing after the backslash */
   switch (*s) {
     case 'u':
       return len < 6 ? JSON_STRING_INCOMPLETE
@@ -239,6 +336,13 @@ static int json_parse_string(struct frozen *f) {
   {
     SET_STATE(f, f->cur, "", 0);
     for (; f->cur < f->end; f->cur += len) {
+#if JSON_ENABLE_SWAR
+      while (json_left(f) >= JSON_WORD_SIZE &&
+             json_word_is_plain(json_load_word(f->cur))) {
+        f->cur += JSON_WORD_SIZE;
+      }
+      if (f->cur >= f->end) break;
+#endif
       ch = *(unsigned char *) f->cur;
       len = json_get_utf8_char_len((unsigned char) ch);
       EXPECT(ch >= 32 && len > 0, JSON_STRING_INVALID); /* No control chars */
@@ -270,12 +374,12 @@ static int json_parse_number(struct frozen *f) {
     while (f->cur < f->end && json_isxdigit(f->cur[0])) f->cur++;
   } else {
     EXPECT(json_isdigit(f->cur[0]), JSON_STRING_INVALID);
-    while (f->cur < f->end && json_isdigit(f->cur[0])) f->cur++;
+    json_skip_digits(f);
     if (f->cur < f->end && f->cur[0] == '.') {
       f->cur++;
       EXPECT(f->cur < f->end, JSON_STRING_INCOMPLETE);
       EXPECT(json_isdigit(f->cur[0]), JSON_STRING_INVALID);
-      while (f->cur < f->end && json_isdigit(f->cur[0])) f->cur++;
+      json_skip_digits(f);
     }
     if (f->cur < f->end && (f->cur[0] == 'e' || f->cur[0] == 'E')) {
       f->cur++;
@@ -283,7 +387,7 @@ static int json_parse_number(struct frozen *f) {
       if ((f->cur[0] == '+' || f->cur[0] == '-')) f->cur++;
       EXPECT(f->cur < f->end, JSON_STRING_INCOMPLETE);
       EXPECT(json_isdigit(f->cur[0]), JSON_STRING_INVALID);
-      while (f->cur < f->end && json_isdigit(f->cur[0])) f->cur++;
+      json_skip_digits(f);
     }
   }
   json_truncate_path(f, fstate.path_len);
@@ -291,36 +395,6 @@ static int json_parse_number(struct frozen *f) {
   return 0;
 }
 
-#if JSON_ENABLE_ARRAY
-/* array = '[' [ value { ',' value } ] ']' */
-static int json_parse_array(struct frozen *f) {
-  int i = 0, current_path_len;
-  char buf[20];
-  CALL_BACK(f, JSON_TYPE_ARRAY_START, NULL, 0);
-  TRY(json_test_and_skip(f, '['));
-  {
-    {
-      SET_STATE(f, f->cur - 1, "", 0);
-      while (json_cur(f) != ']') {
-        snprintf(buf, sizeof(buf), "[%d]", i);
-        i++;
-        current_path_len = json_append_to_path(f, buf, strlen(buf));
-        f->cur_name =
-            f->path + strlen(f->path) - strlen(buf) + 1 /*opening brace*/;
-        f->cur_name_len = strlen(buf) - 2 /*braces*/;
-        TRY(json_parse_value(f));
-        json_truncate_path(f, current_path_len);
-        if (json_cur(f) == ',') f->cur++;
-      }
-      TRY(json_test_and_skip(f, ']'));
-      json_truncate_path(f, fstate.path_len);
-      CALL_BACK(f, JSON_TYPE_ARRAY_END, fstate.ptr, f->cur - fstate.ptr);
-    }
-  }
-  return 0;
-}
-#endif /* JSON_ENABLE_ARRAY */
-
 static int json_expect(struct frozen *f, const char *s, int len,
                        enum json_token_type tok_type) {
   int i, n = json_left(f);
@@ -337,25 +411,64 @@ static int json_expect(struct frozen *f, const char *s, int len,
   return 0;
 }
 
-/* value = 'null' | 'true' | 'false' | number | string | array | object */
-static int json_parse_value(struct frozen *f) {
+/* key = identifier | string */
+static int json_parse_key(struct frozen *f) {
   int ch = json_cur(f);
+  if (json_isalpha(ch)) {
+    TRY(json_parse_identifier(f));
+  } else if (ch == '"') {
+    TRY(json_parse_string(f));
+  } else {
+    return ch == END_OF_STRING ? JSON_STRING_INCOMPLETE : JSON_STRING_INVALID;
+  }
+  return 0;
+}
+
+/* Enter an object or array: report its start and push a frame for it */
+static int json_open(struct frozen *f, int ch) {
+  struct json_frame *frame;
+  if (f->depth >= JSON_MAX_NESTING) return JSON_DEPTH_LIMIT;
+  CALL_BACK(f, ch == '{' ? JSON_TYPE_OBJECT_START : JSON_TYPE_ARRAY_START,
+            NULL, 0);
+  f->cur++;
+  frame = &f->stack[f->depth++];
+  frame->start = f->cur - 1;
+  frame->path_len = f->path_len;
+  frame->index = ch == '{' ? -1 : 0;
+  if (ch == '{') json_append_to_path(f, ".", 1);
+  frame->member_path_len = f->path_len;
+  return 0;
+}
+
+/*
+ * value = 'null' | 'true' | 'false' | number | string | array | object
+ * array = '[' [ value { ',' value } ] ']'
+ * object = '{' pair { ',' pair } '}'
+ * pair = key ':' value
+ *
+ * Objects and arrays are tracked on the explicit `f->stack`, so this runs in
+ * constant C stack regardless of nesting; see JSON_MAX_NESTING.
+ */
+static int json_parse_value(struct frozen *f) {
+  struct json_frame *top;
+  const char *tok;
+  char buf[20];
+  int ch, n;
 
-  if (--f->limit <= 0)
-    return JSON_DEPTH_LIMIT;
+value:
+  if (--f->limit <= 0) return JSON_DEPTH_LIMIT;
 
+  ch = json_cur(f);
   switch (ch) {
     case '"':
       TRY(json_parse_string(f));
       break;
     case '{':
-      TRY(json_parse_object(f));
-      break;
 #if JSON_ENABLE_ARRAY
     case '[':
-      TRY(json_parse_array(f));
-      break;
 #endif
+      TRY(json_open(f, ch));
+      goto member;
     case 'n':
       TRY(json_expect(f, "null", 4, JSON_TYPE_NULL));
       break;
@@ -381,57 +494,43 @@ static int json_parse_value(struct frozen *f) {
     default:
       return ch == END_OF_STRING ? JSON_STRING_INCOMPLETE : JSON_STRING_INVALID;
   }
-
   f->limit++;
-  return 0;
-}
 
-/* key = identifier | string */
-static int json_parse_key(struct frozen *f) {
-  int ch = json_cur(f);
-  if (json_isalpha(ch)) {
-    TRY(json_parse_identifier(f));
-  } else if (ch == '"') {
-    TRY(json_parse_string(f));
-  } else {
-    return ch == END_OF_STRING ? JSON_STRING_INCOMPLETE : JSON_STRING_INVALID;
+done:
+  /* A value is complete; carry on with the enclosing container, if any */
+  if (f->depth == 0) return 0;
+  json_truncate_path(f, f->stack[f->depth - 1].member_path_len);
+  if (json_cur(f) == ',') f->cur++;
+
+member:
+  top = &f->stack[f->depth - 1];
+  ch = json_cur(f);
+  if (ch == (top->index < 0 ? '}' : ']')) {
+    f->cur++;
+    json_truncate_path(f, top->path_len);
+    CALL_BACK(f, top->index < 0 ? JSON_TYPE_OBJECT_END : JSON_TYPE_ARRAY_END,
+              top->start, f->cur - top->start);
+    f->depth--;
+    f->limit++;
+    goto done;
   }
-  return 0;
-}
 
-/* pair = key ':' value */
-static int json_parse_pair(struct frozen *f) {
-  int current_path_len;
-  const char *tok;
-  json_skip_whitespaces(f);
-  tok = f->cur;
-  TRY(json_parse_key(f));
-  {
+  if (top->index < 0) {
+    json_skip_whitespaces(f);
+    tok = f->cur;
+    TRY(json_parse_key(f));
     f->cur_name = *tok == '"' ? tok + 1 : tok;
     f->cur_name_len = *tok == '"' ? f->cur - tok - 2 : f->cur - tok;
-    current_path_len = json_append_to_path(f, f->cur_name, f->cur_name_len);
-  }
-  TRY(json_test_and_skip(f, ':'));
-  TRY(json_parse_value(f));
-  json_truncate_path(f, current_path_len);
-  return 0;
-}
-
-/* object = '{' pair { ',' pair } '}' */
-static int json_parse_object(struct frozen *f) {
-  CALL_BACK(f, JSON_TYPE_OBJECT_START, NULL, 0);
-  TRY(json_test_and_skip(f, '{'));
-  {
-    SET_STATE(f, f->cur - 1, ".", 1);
-    while (json_cur(f) != '}') {
-      TRY(json_parse_pair(f));
-      if (json_cur(f) == ',') f->cur++;
-    }
-    TRY(json_test_and_skip(f, '}'));
-    json_truncate_path(f, fstate.path_len);
-    CALL_BACK(f, JSON_TYPE_OBJECT_END, fstate.ptr, f->cur - fstate.ptr);
+    json_append_to_path(f, f->cur_name, f->cur_name_len);
+    TRY(json_test_and_skip(f, ':'));
+  } else {
+    snprintf(buf, sizeof(buf), "[%d]", top->index++);
+    n = strlen(buf);
+    json_append_to_path(f, buf, n);
+    f->cur_name = f->path + f->path_len - n + 1 /*opening brace*/;
+    f->cur_name_len = n - 2 /*braces*/;
   }
-  return 0;
+  goto value;
 }
 
 static int json_doit(struct frozen *f) {
@@ -440,29 +539,113 @@ static int json_doit(struct frozen *f) {
   return json_parse_value(f);
 }
 
+/*
+ * Every heap allocation made by Frozen goes through these, so that
+ * JSON_ZERO_HEAP can turn them off and json_heap_allocs() can count them.
+ */
+static unsigned long s_json_heap_allocs = 0;
+
+static void *json_malloc(size_t size) {
+#if JSON_ZERO_HEAP
+  (void) size;
+  return NULL;
+#else
+  s_json_heap_allocs++;
+  return malloc(size);
+#endif
+}
+
+static void *json_realloc(void *ptr, size_t size) {
+#if JSON_ZERO_HEAP
+  (void) ptr;
+  (void) size;
+  return NULL;
+#else
+  s_json_heap_allocs++;
+  return realloc(ptr, size);
+#endif
+}
+
+static void json_free(void *ptr) {
+  free(ptr);
+}
+
+unsigned long json_heap_allocs(void) WEAK;
+unsigned long json_heap_allocs(void) {
+  return s_json_heap_allocs;
+}
+
+void json_arena_init(struct json_arena *arena, char *buf, size_t size) WEAK;
+void json_arena_init(struct json_arena *arena, char *buf, size_t size) {
+  arena->buf = buf;
+  arena->size = size;
+  arena->used = 0;
+}
+
+void json_arena_reset(struct json_arena *arena) WEAK;
+void json_arena_reset(struct json_arena *arena) {
+  arena->used = 0;
+}
+
+void *json_arena_alloc(struct json_arena *arena, size_t size) WEAK;
+void *json_arena_alloc(struct json_arena *arena, size_t size) {
+  char *p;
+  if (size > arena->size - arena->used) return NULL;
+  p = arena->buf + arena->used;
+  arena->used += size;
+  return p;
+}
+
+/* True if json_escape() copies `ch` to the output unchanged */
+static int json_escape_is_clean(unsigned char ch) {
+  return ch >= 0x20 && ch != 0x7f && ch != '"' && ch != '\\';
+}
+
+#if JSON_ENABLE_SWAR
+static int json_word_is_clean(json_word_t w) {
+  return !(json_word_has_less(w, 0x20) | json_word_has_byte(w, 0x7f) |
+           json_word_has_byte(w, '"') | json_word_has_byte(w, '\\'));
+}
+#endif
+
 int json_escape(struct json_out *out, const char *p, size_t len) WEAK;
 int json_escape(struct json_out *out, const char *p, size_t len) {
-  size_t i, cl, n = 0;
+  size_t i = 0, run, n = 0;
   const char *hex_digits = "0123456789abcdef";
   const char *specials = "btnvfr";
+  char esc[6];
 
-  for (i = 0; i < len; i++) {
-    unsigned char ch = ((unsigned char *) p)[i];
+  while (i < len) {
+    unsigned char ch;
+
+    /* Hand each run of characters that need no escaping over in one call */
+    run = i;
+#if JSON_ENABLE_SWAR
+    while (len - run >= JSON_WORD_SIZE &&
+           json_word_is_clean(json_load_word(p + run))) {
+      run += JSON_WORD_SIZE;
+    }
+#endif
+    while (run < len && json_escape_is_clean(((unsigned char *) p)[run])) run++;
+    if (run > i) {
+      n += out->printer(out, p + i, run - i);
+      i = run;
+      if (i == len) break;
+    }
+
+    ch = ((unsigned char *) p)[i++];
+    esc[0] = '\\';
     if (ch == '"' || ch == '\\') {
-      n += out->printer(out, "\\", 1);
-      n += out->printer(out, p + i, 1);
+      esc[1] = ch;
+      n += out->printer(out, esc, 2);
     } else if (ch >= '\b' && ch <= '\r') {
-      n += out->printer(out, "\\", 1);
-      n += out->printer(out, &specials[ch - '\b'], 1);
-    } else if (isprint(ch)) {
-      n += out->printer(out, p + i, 1);
-    } else if ((cl = json_get_utf8_char_len(ch)) == 1) {
-      n += out->printer(out, "\\u00", 4);
-      n += out->printer(out, &hex_digits[(ch >> 4) % 0xf], 1);
-      n += out->printer(out, &hex_digits[ch % 0xf], 1);
+      esc[1] = specials[ch - '\b'];
+      n += out->printer(out, esc, 2);
     } else {
-      n += out->printer(out, p + i, cl);
-      i += cl - 1;
+      memcpy(esc + 1, "u00", 3);
+      esc[4] = hex_digits[(ch >> 4) & 0xf];
+      esc[5] = hex_digits[ch & 0xf];
+      n += out->printer(out, esc, 6);
     }
   }
 
@@ -559,6 +742,108 @@ static unsigned char hexdec(const char *s) {
   return (HEXTOI(a) << 4) | HEXTOI(b);
 }
 
+static const char json_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/*
+ * Print `v` in decimal so that it ends right before `end`, two digits per
+ * division. Return the first character. 64-bit division is a library call on
+ * 32-bit targets, so it is only used while the value does not fit 32 bits.
+ */
+static char *json_utoa(char *end, uint64_t v) {
+  uint32_t v32;
+  while (v > 0xffffffffu) {
+    uint64_t q = v / 100;
+    end -= 2;
+    memcpy(end, &json_digit_pairs[(v - q * 100) * 2], 2);
+    v = q;
+  }
+  v32 = (uint32_t) v;
+  while (v32 >= 100) {
+    uint32_t q = v32 / 100;
+    end -= 2;
+    memcpy(end, &json_digit_pairs[(v32 - q * 100) * 2], 2);
+    v32 = q;
+  }
+  if (v32 >= 10) {
+    end -= 2;
+    memcpy(end, &json_digit_pairs[v32 * 2], 2);
+  } else {
+    *--end = (char) ('0' + v32);
+  }
+  return end;
+}
+
+static char *json_xtoa(char *end, uint64_t v) {
+  const char *hex = "0123456789abcdef";
+  do {
+    *--end = hex[v & 0xf];
+    v >>= 4;
+  } while (v != 0);
+  return end;
+}
+
+int json_format_fixed(char *buf, long value, int decimals) WEAK;
+int json_format_fixed(char *buf, long value, int decimals) {
+  char tmp[24], *end = tmp + sizeof(tmp), *p;
+  unsigned long v = value < 0 ? 0 - (unsigned long) value : (unsigned long) value;
+  int n = 0, int_len;
+
+  if (decimals < 0) decimals = 0;
+  if (decimals > 9) decimals = 9;
+
+  p = json_utoa(end, v);
+  while (end - p <= decimals) *--p = '0'; /* At least one integer digit */
+  int_len = (end - p) - decimals;
+
+  if (value < 0) buf[n++] = '-';
+  memcpy(buf + n, p, int_len);
+  n += int_len;
+  if (decimals > 0) {
+    buf[n++] = '.';
+    memcpy(buf + n, p + int_len, decimals);
+    n += decimals;
+  }
+  buf[n] = '\0';
+  return n;
+}
+
+/*
+ * If `fmt` (just after '%') is a plain integer conversion, i.e. d, u or x
+ * with an optional l or ll modifier, return its length, else 0.
+ */
+static int json_int_spec_len(const char *fmt) {
+  int n = 0;
+  while (n < 2 && fmt[n] == 'l') n++;
+  return fmt[n] == 'd' || fmt[n] == 'u' || fmt[n] == 'x' ? n + 1 : 0;
+}
+
+/*
+ * If `fmt` (just after '%') is a `D` conversion with an optional literal
+ * precision, return its length and store the precision in `decimals`, or -1
+ * if it is out of range. Else return 0.
+ */
+static int json_fixed_spec_len(const char *fmt, int *decimals) {
+  int n = 0;
+  *decimals = 0;
+  if (fmt[0] == '.') {
+    for (n = 1; json_isdigit(fmt[n]); n++) {
+      if (*decimals >= 0) *decimals = *decimals * 10 + fmt[n] - '0';
+      if (*decimals > 9) *decimals = -1;
+    }
+  }
+  return fmt[n] == 'D' ? n + 1 : 0;
+}
+
 int json_vprintf(struct json_out *out, const char *fmt, va_list xap) WEAK;
 int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
   int len = 0;
@@ -567,23 +852,52 @@ int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
   va_copy(ap, xap);
 
   while (*fmt != '\0') {
-    if (strchr(":, \r\n\t[]{}\"", *fmt) != NULL) {
-      len += out->printer(out, fmt, 1);
-      fmt++;
+    if (*fmt != '%' && *fmt != '_' && !json_isalpha(*fmt)) {
+      /* Copy literal text up to the next conversion or identifier at once */
+      const char *lit = fmt++;
+      while (*fmt != '\0' && *fmt != '%' && *fmt != '_' &&
+             !json_isalpha(*fmt)) {
+        fmt++;
+      }
+      len += out->printer(out, lit, fmt - lit);
     } else if (fmt[0] == '%') {
-      char buf[21];
+      char buf[24];
       size_t skip = 2;
 
-      if (fmt[1] == 'l' && fmt[2] == 'l' && (fmt[3] == 'd' || fmt[3] == 'u')) {
-        int64_t val = va_arg(ap, int64_t);
-        const char *fmt2 = fmt[3] == 'u' ? "%" UINT64_FMT : "%" INT64_FMT;
-        snprintf(buf, sizeof(buf), fmt2, val);
-        len += out->printer(out, buf, strlen(buf));
-        skip += 2;
+      int spec_len = json_int_spec_len(fmt + 1), decimals;
+      int fixed_len = json_fixed_spec_len(fmt + 1, &decimals);
+
+      if (spec_len > 0) {
+        char conv = fmt[spec_len], *end = buf + sizeof(buf), *p;
+        int longs = spec_len - 1, neg = 0;
+        uint64_t val;
+        if (conv == 'd') {
+          int64_t sval = longs == 2   ? va_arg(ap, int64_t)
+                         : longs == 1 ? (int64_t) va_arg(ap, long)
+                                      : (int64_t) va_arg(ap, int);
+          neg = sval < 0;
+          val = neg ? 0 - (uint64_t) sval : (uint64_t) sval;
+        } else {
+          val = longs == 2   ? va_arg(ap, uint64_t)
+                : longs == 1 ? (uint64_t) va_arg(ap, unsigned long)
+                             : (uint64_t) va_arg(ap, unsigned int);
+        }
+        p = conv == 'x' ? json_xtoa(end, val) : json_utoa(end, val);
+        if (neg) *--p = '-';
+        len += out->printer(out, p, end - p);
+        skip = spec_len + 1;
+      } else if (fixed_len > 0) {
+        int val = va_arg(ap, int);
+        if (decimals < 0) {
+          len += out->printer(out, null, 4);
+        } else {
+          len += out->printer(out, buf, json_format_fixed(buf, val, decimals));
+        }
+        skip = fixed_len + 1;
       } else if (fmt[1] == 'z' && fmt[2] == 'u') {
         size_t val = va_arg(ap, size_t);
-        snprintf(buf, sizeof(buf), "%lu", (unsigned long) val);
-        len += out->printer(out, buf, strlen(buf));
+        char *end = buf + sizeof(buf), *p = json_utoa(end, val);
+        len += out->printer(out, p, end - p);
         skip += 1;
       } else if (fmt[1] == 'M') {
         json_printf_callback_t f = va_arg(ap, json_printf_callback_t);
@@ -633,6 +947,27 @@ int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
           len += json_escape(out, p, l);
           len += out->printer(out, quote, 1);
         }
+      } else if (fmt[1] == 's' ||
+                 (fmt[1] == '.' && fmt[2] == '*' && fmt[3] == 's')) {
+        /* Plain strings go straight to the printer, without vsnprintf */
+        int prec = -1;
+        size_t l;
+        const char *p, *nul;
+
+        if (fmt[1] == '.') {
+          prec = va_arg(ap, int);
+          skip += 2;
+        }
+        p = va_arg(ap, char *);
+        if (p == NULL) p = "(null)";
+
+        if (prec < 0) {
+          l = strlen(p);
+        } else {
+          nul = (const char *) memchr(p, '\0', (size_t) prec);
+          l = nul != NULL ? (size_t)(nul - p) : (size_t) prec;
+        }
+        len += out->printer(out, p, l);
       } else {
         /*
          * we delegate printing to the system printf.
@@ -640,9 +975,9 @@ int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
          * printf, as you can see below we still have to parse the format
          * types.
          *
-         * Currently, %s with strings longer than 20 chars will require
-         * double-buffering (an auxiliary buffer will be allocated from heap).
-         * TODO(dfrank): reimplement %s and %.*s in order to avoid that.
+         * Strings with a width or other modifiers whose output is longer
+         * than 20 chars still require double-buffering (an auxiliary buffer
+         * will be allocated from heap). If that fails, `null` is printed.
          */
 
         const char *end_of_format_specifier = "sdfFeEgGlhuIcx.*-0123456789";
@@ -653,10 +988,17 @@ int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
         va_list ap_copy;
         strncpy(fmt2, fmt,
                 n + 1 > (int) sizeof(fmt2) ? sizeof(fmt2) : (size_t) n + 1);
-        fmt2[n + 1] = '\0';
+        fmt2[n + 1 < (int) sizeof(fmt2) ? n + 1 : (int) sizeof(fmt2) - 1] =
+            '\0';
 
         va_copy(ap_copy, ap);
-        need_len = vsnprintf(pbuf, size, fmt2, ap_copy);
+        if (n + 1 < (int) sizeof(fmt2)) {
+          need_len = vsnprintf(pbuf, size, fmt2, ap_copy);
+        } else {
+          /* Too long for fmt2: print nothing, only consume the argument */
+          buf[0] = '\0';
+          need_len = 0;
+        }
         va_end(ap_copy);
 
         if (need_len < 0) {
@@ -666,9 +1008,9 @@ int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
            */
           pbuf = NULL;
           while (need_len < 0) {
-            free(pbuf);
+            json_free(pbuf);
             size *= 2;
-            if ((pbuf = (char *) malloc(size)) == NULL) break;
+            if ((pbuf = (char *) json_malloc(size)) == NULL) break;
             va_copy(ap_copy, ap);
             need_len = vsnprintf(pbuf, size, fmt2, ap_copy);
             va_end(ap_copy);
@@ -678,14 +1020,15 @@ int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
            * resulting string doesn't fit into a stack-allocated buffer `buf`,
            * so we need to allocate a new buffer from heap and use it
            */
-          if ((pbuf = (char *) malloc(need_len + 1)) != NULL) {
+          if ((pbuf = (char *) json_malloc(need_len + 1)) != NULL) {
             va_copy(ap_copy, ap);
             vsnprintf(pbuf, need_len + 1, fmt2, ap_copy);
             va_end(ap_copy);
           }
         }
         if (pbuf == NULL) {
-          buf[0] = '\0';
+          /* No heap: a truncated value would still look valid, print null */
+          strcpy(buf, "null");
           pbuf = buf;
         }
 
@@ -704,7 +1047,7 @@ int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
           (void) va_arg(ap, int);
           (void) va_arg(ap, char *);
         } else {
-          switch (fmt2[n]) {
+          switch (fmt[n]) { /* fmt2 may be truncated */
             case 'u':
             case 'd':
               (void) va_arg(ap, int);
@@ -727,21 +1070,17 @@ int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
 
         /* If buffer was allocated from heap, free it */
         if (pbuf != buf) {
-          free(pbuf);
+          json_free(pbuf);
           pbuf = NULL;
         }
       }
       fmt += skip;
     } else if (*fmt == '_' || json_isalpha(*fmt)) {
+      const char *id = fmt;
+      while (*fmt == '_' || json_isalpha(*fmt) || json_isdigit(*fmt)) fmt++;
       len += out->printer(out, quote, 1);
-      while (*fmt == '_' || json_isalpha(*fmt) || json_isdigit(*fmt)) {
-        len += out->printer(out, fmt, 1);
-        fmt++;
-      }
+      len += out->printer(out, id, fmt - id);
       len += out->printer(out, quote, 1);
-    } else {
-      len += out->printer(out, fmt, 1);
-      fmt++;
     }
   }
   va_end(ap);
@@ -852,6 +1191,339 @@ int json_walk_args(const char *json_string, int json_string_length,
   return (frozen->cur - json_string);
 }
 
+enum json_stream_state {
+  JSON_STREAM_VALUE,        /* Expecting a value */
+  JSON_STREAM_VALUE_OR_END, /* After '[' or ',' inside an array */
+  JSON_STREAM_KEY_OR_END,   /* After '{' or ',' inside an object */
+  JSON_STREAM_COLON,        /* After an object key */
+  JSON_STREAM_AFTER_VALUE,  /* Expecting ',' or a closing bracket */
+  JSON_STREAM_STRING,       /* Inside a string value */
+  JSON_STREAM_KEY,          /* Inside a quoted key */
+  JSON_STREAM_IDENT,        /* Inside an unquoted key */
+  JSON_STREAM_SCALAR,       /* Inside a number or true/false/null */
+  JSON_STREAM_DONE          /* Top-level value complete */
+};
+
+/* `escape` value while waiting for the character after a backslash */
+#define JSON_STREAM_ESCAPE_CODE 5
+
+void json_stream_init(struct json_stream *s, json_walk_callback_t callback,
+                      void *callback_data) WEAK;
+void json_stream_init(struct json_stream *s, json_walk_callback_t callback,
+                      void *callback_data) {
+  memset(s, 0, sizeof(*s));
+  s->callback = callback;
+  s->callback_data = callback_data;
+  s->state = JSON_STREAM_VALUE;
+}
+
+static void json_stream_call(struct json_stream *s, enum json_token_type type,
+                             const char *ptr, int len) {
+  if (s->callback != NULL) {
+    struct json_token t = {ptr, len, type};
+    /* Names always follow '.' or '[', so offset 0 means "no name" */
+    const char *name = s->name_off == 0 ? NULL : s->path + s->name_off;
+    s->callback(s->callback_data, name, s->name_len, s->path, &t);
+  }
+  s->name_off = 0;
+  s->name_len = 0;
+}
+
+static int json_stream_append_path(struct json_stream *s, const char *str,
+                                   int len) {
+  if (s->path_len + len > JSON_STREAM_MAX_PATH) return JSON_TOKEN_TOO_LONG;
+  memcpy(s->path + s->path_len, str, len);
+  s->path_len += len;
+  s->path[s->path_len] = '\0';
+  return 0;
+}
+
+static int json_stream_push(struct json_stream *s, int ch) {
+  if (s->token_len >= JSON_STREAM_MAX_TOKEN) return JSON_TOKEN_TOO_LONG;
+  s->token[s->token_len++] = (char) ch;
+  return 0;
+}
+
+/* A value starts: inside an array, its path gets the next index */
+static int json_stream_begin_value(struct json_stream *s) {
+  int d = s->depth - 1;
+  if (s->depth > 0 && s->containers[d] == '[') {
+    char buf[8];
+    int n = snprintf(buf, sizeof(buf), "[%d]", s->indexes[d]++);
+    TRY(json_stream_append_path(s, buf, n));
+    s->name_off = s->path_len - n + 1;
+    s->name_len = n - 2;
+  }
+  s->token_len = 0;
+  return 0;
+}
+
+/* A value ended: drop its key or index from the path */
+static void json_stream_end_value(struct json_stream *s) {
+  s->path_len = s->depth > 0 ? s->path_lens[s->depth - 1] : 0;
+  s->path[s->path_len] = '\0';
+  s->name_off = 0;
+  s->name_len = 0;
+  s->state = s->depth > 0 ? JSON_STREAM_AFTER_VALUE : JSON_STREAM_DONE;
+}
+
+static int json_stream_open(struct json_stream *s, int ch) {
+  if (s->depth >= JSON_STREAM_MAX_DEPTH) return JSON_DEPTH_LIMIT;
+  TRY(json_stream_begin_value(s));
+  json_stream_call(s, ch == '{' ? JSON_TYPE_OBJECT_START
+                                : JSON_TYPE_ARRAY_START, NULL, 0);
+  s->containers[s->depth] = (char) ch;
+  s->indexes[s->depth] = 0;
+  s->path_lens[s->depth] = s->path_len;
+  s->depth++;
+  s->state = ch == '{' ? JSON_STREAM_KEY_OR_END : JSON_STREAM_VALUE_OR_END;
+  return 0;
+}
+
+static int json_stream_close(struct json_stream *s, int ch) {
+  int d = s->depth - 1;
+  if (s->depth == 0 || s->containers[d] != (ch == '}' ? '{' : '[')) {
+    return JSON_STRING_INVALID;
+  }
+  s->depth--;
+  s->path_len = s->path_lens[d];
+  s->path[s->path_len] = '\0';
+  json_stream_call(s, ch == '}' ? JSON_TYPE_OBJECT_END : JSON_TYPE_ARRAY_END,
+                   NULL, 0);
+  json_stream_end_value(s);
+  return 0;
+}
+
+static int json_stream_end_key(struct json_stream *s) {
+  TRY(json_stream_append_path(s, ".", 1));
+  TRY(json_stream_append_path(s, s->token, s->token_len));
+  s->name_off = s->path_len - s->token_len;
+  s->name_len = s->token_len;
+  s->state = JSON_STREAM_COLON;
+  return 0;
+}
+
+/* Skip a run of digits at `p[i]`, return the index past it, or -1 if none */
+static int json_skip_number_digits(const char *p, int len, int i,
+                                   int (*is_digit)(int)) {
+  int start = i;
+  while (i < len && is_digit(p[i])) i++;
+  return i > start ? i : -1;
+}
+
+/*
+ * True if `p` is exactly one number, with the same grammar as
+ * json_parse_number(). Used by the stream parser, which cannot afford a
+ * nested json_walk() and its parser state on the stack.
+ */
+static int json_is_number(const char *p, int len) {
+  int i = 0;
+  if (i < len && p[i] == '-') i++;
+  if (i + 1 < len && p[i] == '0' && p[i + 1] == 'x') {
+    i = json_skip_number_digits(p, len, i + 2, json_isxdigit);
+    return i == len;
+  }
+  if ((i = json_skip_number_digits(p, len, i, json_isdigit)) < 0) return 0;
+  if (i < len && p[i] == '.') {
+    if ((i = json_skip_number_digits(p, len, i + 1, json_isdigit)) < 0) {
+      return 0;
+    }
+  }
+  if (i < len && (p[i] == 'e' || p[i] == 'E')) {
+    i++;
+    if (i < len && (p[i] == '+' || p[i] == '-')) i++;
+    if ((i = json_skip_number_digits(p, len, i, json_isdigit)) < 0) return 0;
+  }
+  return i == len;
+}
+
+static int json_stream_end_scalar(struct json_stream *s) {
+  const char *literal = s->token_type == JSON_TYPE_TRUE    ? "true"
+                        : s->token_type == JSON_TYPE_FALSE ? "false"
+                                                           : "null";
+  if (s->token_type == JSON_TYPE_NUMBER) {
+    EXPECT(json_is_number(s->token, s->token_len), JSON_STRING_INVALID);
+  } else {
+    EXPECT(s->token_len == (int) strlen(literal) &&
+               memcmp(s->token, literal, s->token_len) == 0,
+           JSON_STRING_INVALID);
+  }
+  json_stream_call(s, (enum json_token_type) s->token_type, s->token,
+                   s->token_len);
+  json_stream_end_value(s);
+  return 0;
+}
+
+/* Handle the first character of a value */
+static int json_stream_value(struct json_stream *s, int ch) {
+  switch (ch) {
+    case '{':
+    case '[':
+      return json_stream_open(s, ch);
+    case '"':
+      TRY(json_stream_begin_value(s));
+      s->escape = 0;
+      s->token_skipped = 0;
+      s->state = JSON_STREAM_STRING;
+      return 0;
+    case 't':
+    case 'f':
+    case 'n':
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+      TRY(json_stream_begin_value(s));
+      s->token_type = ch == 't'   ? JSON_TYPE_TRUE
+                      : ch == 'f' ? JSON_TYPE_FALSE
+                      : ch == 'n' ? JSON_TYPE_NULL
+                                  : JSON_TYPE_NUMBER;
+      s->state = JSON_STREAM_SCALAR;
+      return json_stream_push(s, ch);
+    default:
+      return JSON_STRING_INVALID;
+  }
+}
+
+/* Handle one character inside a string; return 1 on the closing quote */
+static int json_stream_string_char(struct json_stream *s, int ch) {
+  EXPECT(ch >= 32, JSON_STRING_INVALID); /* No control chars */
+  if (s->escape == JSON_STREAM_ESCAPE_CODE) {
+    EXPECT(strchr("\"\\/bfnrtu", ch) != NULL, JSON_STRING_INVALID);
+    s->escape = ch == 'u' ? 4 : 0;
+  } else if (s->escape > 0) {
+    EXPECT(json_isxdigit(ch), JSON_STRING_INVALID);
+    s->escape--;
+  } else if (ch == '\\') {
+    s->escape = JSON_STREAM_ESCAPE_CODE;
+  } else if (ch == '"') {
+    return 1;
+  }
+  if (s->state == JSON_STREAM_STRING && s->token_len >= JSON_STREAM_MAX_TOKEN) {
+    s->token_skipped = 1; /* Still checked, no longer buffered */
+    return 0;
+  }
+  TRY(json_stream_push(s, ch));
+  return 0;
+}
+
+static int json_stream_char(struct json_stream *s, int ch) {
+  int n;
+
+  switch (s->state) {
+    case JSON_STREAM_STRING:
+      TRY(n = json_stream_string_char(s, ch));
+      if (n == 1) {
+        if (s->token_skipped) {
+          json_stream_call(s, JSON_TYPE_STRING, NULL, 0);
+        } else {
+          json_stream_call(s, JSON_TYPE_STRING, s->token, s->token_len);
+        }
+        json_stream_end_value(s);
+      }
+      return 1;
+    case JSON_STREAM_KEY:
+      TRY(n = json_stream_string_char(s, ch));
+      if (n == 1) TRY(json_stream_end_key(s));
+      return 1;
+    case JSON_STREAM_IDENT:
+      if (ch == '_' || json_isalpha(ch) || json_isdigit(ch)) {
+        TRY(json_stream_push(s, ch));
+        return 1;
+      }
+      TRY(json_stream_end_key(s));
+      return 0; /* Not consumed: handle it in the new state */
+    case JSON_STREAM_SCALAR:
+      if (json_isalpha(ch) || json_isdigit(ch) || ch == '.' || ch == '+' ||
+          ch == '-') {
+        TRY(json_stream_push(s, ch));
+        return 1;
+      }
+      TRY(json_stream_end_scalar(s));
+      return 0; /* Not consumed: handle it in the new state */
+    default:
+      break;
+  }
+
+  if (json_isspace(ch)) return 1;
+
+  switch (s->state) {
+    case JSON_STREAM_VALUE_OR_END:
+      if (ch == ']') {
+        TRY(json_stream_close(s, ch));
+        break;
+      }
+      /* FALLTHROUGH */
+    case JSON_STREAM_VALUE:
+      TRY(json_stream_value(s, ch));
+      break;
+    case JSON_STREAM_KEY_OR_END:
+      s->token_len = 0;
+      s->escape = 0;
+      if (ch == '}') {
+        TRY(json_stream_close(s, ch));
+      } else if (ch == '"') {
+        s->state = JSON_STREAM_KEY;
+      } else if (json_isalpha(ch)) {
+        s->state = JSON_STREAM_IDENT;
+        TRY(json_stream_push(s, ch));
+      } else {
+        return JSON_STRING_INVALID;
+      }
+      break;
+    case JSON_STREAM_COLON:
+      EXPECT(ch == ':', JSON_STRING_INVALID);
+      s->state = JSON_STREAM_VALUE;
+      break;
+    case JSON_STREAM_AFTER_VALUE:
+      if (ch == '}' || ch == ']') {
+        TRY(json_stream_close(s, ch));
+        break;
+      }
+      s->state = s->containers[s->depth - 1] == '{'
+                     ? JSON_STREAM_KEY_OR_END
+                     : JSON_STREAM_VALUE_OR_END;
+      /* Like json_walk(), treat the separating comma as optional */
+      if (ch != ',') return 0;
+      break;
+    default:
+      /* Only whitespace may follow the top-level value */
+      return JSON_STRING_INVALID;
+  }
+  return 1;
+}
+
+int json_stream_feed(struct json_stream *s, const char *buf, int len) WEAK;
+int json_stream_feed(struct json_stream *s, const char *buf, int len) {
+  int i = 0, n;
+  while (s->error == 0 && i < len) {
+    n = json_stream_char(s, ((const unsigned char *) buf)[i]);
+    if (n < 0) {
+      s->error = n;
+    } else {
+      i += n;
+    }
+  }
+  return s->error;
+}
+
+int json_stream_end(struct json_stream *s) WEAK;
+int json_stream_end(struct json_stream *s) {
+  if (s->error == 0 && s->state == JSON_STREAM_SCALAR && s->depth == 0) {
+    /* A top-level number has no terminating character */
+    s->error = json_stream_end_scalar(s);
+  }
+  if (s->error != 0) return s->error;
+  return s->state == JSON_STREAM_DONE ? 0 : JSON_STRING_INCOMPLETE;
+}
+
 struct scan_array_info {
   int found;
   char path[JSON_MAX_PATH_LEN];
@@ -885,6 +1557,117 @@ int json_scanf_array_elem(const char *s, int len, const char *path, int idx,
   return info.found ? token->len : -1;
 }
 
+struct json_index_data {
+  const char *base;
+  struct json_index_token *tokens;
+  int max_tokens;
+  int num_tokens;
+  int container; /* Index of the innermost open object or array */
+  int overflow;
+};
+
+static void json_index_cb(void *callback_data, const char *name,
+                          size_t name_len, const char *path,
+                          const struct json_token *token) {
+  struct json_index_data *data = (struct json_index_data *) callback_data;
+  struct json_index_token *t;
+
+  (void) path;
+
+  if (data->overflow) return;
+
+  if (token->type == JSON_TYPE_OBJECT_END ||
+      token->type == JSON_TYPE_ARRAY_END) {
+    /* Container closed: now its whole text is known */
+    t = &data->tokens[data->container];
+    t->offset = token->ptr - data->base;
+    t->len = token->len;
+    data->container = t->parent;
+    return;
+  }
+
+  if (data->num_tokens >= data->max_tokens) {
+    data->overflow = 1;
+    return;
+  }
+
+  t = &data->tokens[data->num_tokens];
+  t->offset = token->ptr == NULL ? -1 : token->ptr - data->base;
+  t->len = token->len;
+  t->type = token->type;
+  t->parent = data->container;
+  t->key_offset = -1;
+  t->key_len = 0;
+
+  /* Array items are named by their index, which points into the path */
+  if (name != NULL && data->container >= 0 &&
+      data->tokens[data->container].type == JSON_TYPE_OBJECT_END) {
+    t->key_offset = name - data->base;
+    t->key_len = (int) name_len;
+  }
+
+  if (token->type == JSON_TYPE_OBJECT_START) {
+    t->type = JSON_TYPE_OBJECT_END;
+    data->container = data->num_tokens;
+  } else if (token->type == JSON_TYPE_ARRAY_START) {
+    t->type = JSON_TYPE_ARRAY_END;
+    data->container = data->num_tokens;
+  }
+
+  data->num_tokens++;
+}
+
+int json_index(const char *s, int len, struct json_index_token *tokens,
+               int max_tokens) WEAK;
+int json_index(const char *s, int len, struct json_index_token *tokens,
+               int max_tokens) {
+  struct json_index_data data = {s, tokens, max_tokens, 0, -1, 0};
+  TRY(json_walk(s, len, json_index_cb, &data));
+  return data.overflow ? JSON_TOO_MANY_TOKENS : data.num_tokens;
+}
+
+int json_index_find(const char *s, const struct json_index_token *tokens,
+                    int num_tokens, const char *path) WEAK;
+int json_index_find(const char *s, const struct json_index_token *tokens,
+                    int num_tokens, const char *path) {
+  int i = 0, j, end, found, n, idx;
+  const char *key;
+
+  if (num_tokens <= 0) return -1;
+
+  while (*path != '\0') {
+    /* Children of token i follow it, up to the end of its text */
+    end = tokens[i].offset + tokens[i].len;
+    found = -1;
+    if (*path == '.' && tokens[i].type == JSON_TYPE_OBJECT_END) {
+      key = path + 1;
+      n = strcspn(key, ".[");
+      for (j = i + 1; j < num_tokens && tokens[j].offset < end; j++) {
+        if (tokens[j].parent == i && tokens[j].key_len == n &&
+            memcmp(s + tokens[j].key_offset, key, n) == 0) {
+          found = j;
+        }
+      }
+      path = key + n;
+    } else if (*path == '[' && tokens[i].type == JSON_TYPE_ARRAY_END) {
+      char *endptr = NULL;
+      idx = (int) strtol(path + 1, &endptr, 10);
+      if (endptr == path + 1 || *endptr != ']') return -1;
+      for (j = i + 1; j < num_tokens && tokens[j].offset < end; j++) {
+        if (tokens[j].parent == i && idx-- == 0) {
+          found = j;
+          break;
+        }
+      }
+      path = endptr + 1;
+    }
+    if (found < 0) return -1;
+    i = found;
+  }
+
+  return i;
+}
+
 struct json_scanf_info {
   int num_conversions;
   char *path;
@@ -892,8 +1675,14 @@ struct json_scanf_info {
   void *target;
   void *user_data;
   int type;
+  struct json_arena *arena; /* Where %Q, %H and %V results go, NULL: heap */
 };
 
+static char *json_scanf_alloc(struct json_scanf_info *info, size_t size) {
+  return info->arena != NULL ? (char *) json_arena_alloc(info->arena, size)
+                             : (char *) json_malloc(size);
+}
+
 int json_unescape(const char *src, int slen, char *dst, int dlen) WEAK;
 int json_unescape(const char *src, int slen, char *dst, int dlen) {
   char *send = (char *) src + slen, *dend = dst + dlen, *orig_dst = dst, *p;
@@ -928,28 +1717,11 @@ int json_unescape(const char *src, int slen, char *dst, int dlen) {
   return dst - orig_dst;
 }
 
-static void json_scanf_cb(void *callback_data, const char *name,
-                          size_t name_len, const char *path,
-                          const struct json_token *token) {
-  struct json_scanf_info *info = (struct json_scanf_info *) callback_data;
+/* Store the matched `token` into the target of the current conversion */
+static void json_scanf_convert(struct json_scanf_info *info,
+                               const struct json_token *token) {
   char buf[32]; /* Must be enough to hold numbers */
 
-  (void) name;
-  (void) name_len;
-
-  if (token->ptr == NULL) {
-    /*
-     * We're not interested here in the events for which we have no value;
-     * namely, JSON_TYPE_OBJECT_START and JSON_TYPE_ARRAY_START
-     */
-    return;
-  }
-
-  if (strcmp(path, info->path) != 0) {
-    /* It's not the path we're looking for, so, just ignore this callback */
-    return;
-  }
-
   switch (info->type) {
     case 'B':
       info->num_conversions++;
@@ -981,13 +1753,13 @@ static void json_scanf_cb(void *callback_data, const char *name,
       } else {
         int unescaped_len = json_unescape(token->ptr, token->len, NULL, 0);
         if (unescaped_len >= 0 &&
-            (*dst = (char *) malloc(unescaped_len + 1)) != NULL) {
+            (*dst = json_scanf_alloc(info, unescaped_len + 1)) != NULL) {
           info->num_conversions++;
           if (json_unescape(token->ptr, token->len, *dst, unescaped_len) ==
               unescaped_len) {
             (*dst)[unescaped_len] = '\0';
           } else {
-            free(*dst);
+            if (info->arena == NULL) json_free(*dst);
             *dst = NULL;
           }
         }
@@ -999,7 +1771,7 @@ static void json_scanf_cb(void *callback_data, const char *name,
       char **dst = (char **) info->user_data;
       int i, len = token->len / 2;
       *(int *) info->target = len;
-      if ((*dst = (char *) malloc(len + 1)) != NULL) {
+      if ((*dst = json_scanf_alloc(info, len + 1)) != NULL) {
         for (i = 0; i < len; i++) {
           (*dst)[i] = hexdec(token->ptr + 2 * i);
         }
@@ -1013,7 +1785,7 @@ static void json_scanf_cb(void *callback_data, const char *name,
 #if JSON_ENABLE_BASE64
       char **dst = (char **) info->target;
       int len = token->len * 4 / 3 + 2;
-      if ((*dst = (char *) malloc(len + 1)) != NULL) {
+      if ((*dst = json_scanf_alloc(info, len + 1)) != NULL) {
         int n = b64dec(token->ptr, token->len, *dst);
         (*dst)[n] = '\0';
         *(int *) info->user_data = n;
@@ -1065,12 +1837,63 @@ static void json_scanf_cb(void *callback_data, const char *name,
   }
 }
 
+static void json_scanf_cb(void *callback_data, const char *name,
+                          size_t name_len, const char *path,
+                          const struct json_token *token) {
+  struct json_scanf_info *info = (struct json_scanf_info *) callback_data;
+
+  (void) name;
+  (void) name_len;
+
+  if (token->ptr == NULL) {
+    /*
+     * We're not interested here in the events for which we have no value;
+     * namely, JSON_TYPE_OBJECT_START and JSON_TYPE_ARRAY_START
+     */
+    return;
+  }
+
+  if (strcmp(path, info->path) != 0) {
+    /* It's not the path we're looking for, so, just ignore this callback */
+    return;
+  }
+
+  json_scanf_convert(info, token);
+}
+
 int json_vscanf(const char *s, int len, const char *fmt, va_list ap) WEAK;
 int json_vscanf(const char *s, int len, const char *fmt, va_list ap) {
+  return json_vscanf_arena(s, len, NULL, fmt, ap);
+}
+
+int json_vscanf_arena(const char *s, int len, struct json_arena *arena,
+                      const char *fmt, va_list ap) WEAK;
+int json_vscanf_arena(const char *s, int len, struct json_arena *arena,
+                      const char *fmt, va_list ap) {
+#if JSON_SCANF_MAX_TOKENS > 0
+  struct json_index_token tokens[JSON_SCANF_MAX_TOKENS];
+  return json_vscanf_index(s, len, tokens, JSON_SCANF_MAX_TOKENS, arena, fmt,
+                           ap);
+#else
+  return json_vscanf_index(s, len, NULL, 0, arena, fmt, ap);
+#endif
+}
+
+int json_vscanf_index(const char *s, int len, struct json_index_token *tokens,
+                      int max_tokens, struct json_arena *arena,
+                      const char *fmt, va_list ap) WEAK;
+int json_vscanf_index(const char *s, int len, struct json_index_token *tokens,
+                      int max_tokens, struct json_arena *arena,
+                      const char *fmt, va_list ap) {
   char path[JSON_MAX_PATH_LEN] = "", fmtbuf[20];
   int i = 0;
   char *p = NULL;
-  struct json_scanf_info info = {0, path, fmtbuf, NULL, NULL, 0};
+  struct json_scanf_info info = {0, path, fmtbuf, NULL, NULL, 0, arena};
+  int num_tokens = JSON_TOO_MANY_TOKENS;
+
+  if (tokens != NULL && max_tokens > 0) {
+    num_tokens = json_index(s, len, tokens, max_tokens);
+  }
 
   while (fmt[i] != '\0') {
     if (fmt[i] == '{') {
@@ -1104,7 +1927,17 @@ int json_vscanf(const char *s, int len, const char *fmt, va_list ap) {
           break;
         }
       }
-      json_walk(s, len, json_scanf_cb, &info);
+      if (num_tokens >= 0) {
+        int t = json_index_find(s, tokens, num_tokens, path);
+        if (t >= 0) {
+          struct json_token token = {s + tokens[t].offset, tokens[t].len,
+                                     tokens[t].type};
+          json_scanf_convert(&info, &token);
+        }
+      } else {
+        /* No index, too big or broken document: one walk per key */
+        json_walk(s, len, json_scanf_cb, &info);
+      }
     } else if (json_isalpha(fmt[i]) || json_get_utf8_char_len(fmt[i]) > 1) {
       char *pe;
       const char *delims = ": \r\n\t";
@@ -1131,6 +1964,32 @@ int json_scanf(const char *str, int len, const char *fmt, ...) {
   return result;
 }
 
+int json_scanf_arena(const char *str, int len, struct json_arena *arena,
+                     const char *fmt, ...) WEAK;
+int json_scanf_arena(const char *str, int len, struct json_arena *arena,
+                     const char *fmt, ...) {
+  int result;
+  va_list ap;
+  va_start(ap, fmt);
+  result = json_vscanf_arena(str, len, arena, fmt, ap);
+  va_end(ap);
+  return result;
+}
+
+int json_scanf_index(const char *str, int len, struct json_index_token *tokens,
+                     int max_tokens, struct json_arena *arena,
+                     const char *fmt, ...) WEAK;
+int json_scanf_index(const char *str, int len, struct json_index_token *tokens,
+                     int max_tokens, struct json_arena *arena,
+                     const char *fmt, ...) {
+  int result;
+  va_list ap;
+  va_start(ap, fmt);
+  result = json_vscanf_index(str, len, tokens, max_tokens, arena, fmt, ap);
+  va_end(ap);
+  return result;
+}
+
 int json_vfprintf(const char *file_name, const char *fmt, va_list ap) WEAK;
 int json_vfprintf(const char *file_name, const char *fmt, va_list ap) {
   int res = -1;
@@ -1163,10 +2022,10 @@ char *json_fread(const char *path) {
     fclose(fp);
   } else {
     long size = ftell(fp);
-    if (size > 0 && (data = (char *) malloc(size + 1)) != NULL) {
+    if (size > 0 && (data = (char *) json_malloc(size + 1)) != NULL) {
       fseek(fp, 0, SEEK_SET); /* Some platforms might not have rewind(), Oo */
       if (fread(data, 1, size, fp) != (size_t) size) {
-        free(data);
+        json_free(data);
         data = NULL;
       } else {
         data[size] = '\0';
@@ -1177,6 +2036,18 @@ char *json_fread(const char *path) {
   return data;
 }
 
+int json_fread_buf(const char *path, char *buf, size_t size) WEAK;
+int json_fread_buf(const char *path, char *buf, size_t size) {
+  FILE *fp;
+  size_t n;
+  if (size == 0 || (fp = fopen(path, "rb")) == NULL) return -1;
+  n = fread(buf, 1, size, fp);
+  fclose(fp);
+  if (n >= size) return -1; /* No room for the whole file and the NUL */
+  buf[n] = '\0';
+  return (int) n;
+}
+
 struct json_setf_data {
   const char *json_path;
   const char *base; /* Pointer to the source JSON string */
@@ -1393,7 +2264,7 @@ int json_prettify_file(const char *file_name) {
     }
     fclose(fp);
   }
-  free(s);
+  json_free(s);
   return res;
 }
 
@@ -1477,7 +2348,7 @@ void *json_next_elem(const char *s, int len, void *handle, const char *path,
 static int json_sprinter(struct json_out *out, const char *str, size_t len) {
   size_t old_len = out->u.buf.buf == NULL ? 0 : strlen(out->u.buf.buf);
   size_t new_len = len + old_len;
-  char *p = (char *) realloc(out->u.buf.buf, new_len + 1);
+  char *p = (char *) json_realloc(out->u.buf.buf, new_len + 1);
   if (p != NULL) {
     memcpy(p + old_len, str, len);
     p[new_len] = '\0';
@@ -1504,3 +2375,26 @@ char *json_asprintf(const char *fmt, ...) {
   va_end(ap);
   return result;
 }
+
+char *json_arena_vprintf(struct json_arena *arena, const char *fmt,
+                         va_list ap) WEAK;
+char *json_arena_vprintf(struct json_arena *arena, const char *fmt,
+                         va_list ap) {
+  size_t avail = arena->size - arena->used;
+  char *p = arena->buf + arena->used;
+  struct json_out out = JSON_OUT_BUF(p, avail);
+  int n = json_vprintf(&out, fmt, ap);
+  if (n < 0 || (size_t) n >= avail) return NULL;
+  arena->used += n + 1;
+  return p;
+}
+
+char *json_arena_printf(struct json_arena *arena, const char *fmt, ...) WEAK;
+char *json_arena_printf(struct json_arena *arena, const char *fmt, ...) {
+  char *result = NULL;
+  va_list ap;
+  va_start(ap, fmt);
+  result = json_arena_vprintf(arena, fmt, ap);
+  va_end(ap);
+  return result;
+}
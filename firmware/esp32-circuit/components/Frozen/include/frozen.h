@@ -68,6 +68,8 @@ struct json_token {
 #define JSON_STRING_INVALID -1
 #define JSON_STRING_INCOMPLETE -2
 #define JSON_DEPTH_LIMIT -3
+#define JSON_TOO_MANY_TOKENS -4
+#define JSON_TOKEN_TOO_LONG -5
 
 /*
  * Callback-based SAX-like API.
@@ -125,6 +127,87 @@ int json_walk_args(const char *json_string, int json_string_length,
 		(ptr)->limit = JSON_MAX_DEPTH;		\
 	} while(0)
 
+/*
+ * Streaming (resumable) parser.
+ *
+ * Parses a document delivered in arbitrary chunks, e.g. as it arrives from
+ * the network, without keeping the document in memory. All state lives in
+ * `struct json_stream`, whose size is fixed at compile time by
+ * JSON_STREAM_MAX_DEPTH, JSON_STREAM_MAX_PATH and JSON_STREAM_MAX_TOKEN.
+ *
+ * The callback receives the same name and path as with `json_walk()`.
+ * Scalar tokens point into the stream's own buffer and are only valid during
+ * the callback. Container events carry no value: both
+ * JSON_TYPE_OBJECT_START/ARRAY_START and JSON_TYPE_OBJECT_END/ARRAY_END are
+ * reported with `ptr` NULL and `len` 0.
+ *
+ * A string value longer than JSON_STREAM_MAX_TOKEN is still checked but not
+ * buffered: it is reported as JSON_TYPE_STRING with `ptr` NULL and `len` 0,
+ * so the rest of the document parses and callbacks that do not need the
+ * value can ignore it. A key or a number longer than JSON_STREAM_MAX_TOKEN,
+ * or a path longer than JSON_STREAM_MAX_PATH, fails with
+ * JSON_TOKEN_TOO_LONG. Nesting deeper than JSON_STREAM_MAX_DEPTH fails with
+ * JSON_DEPTH_LIMIT.
+ *
+ * As with `json_walk()`, strings are checked for control characters and
+ * escape syntax but not for valid UTF-8: bytes 0x80 and above are passed to
+ * the callback as they are.
+ */
+#ifndef JSON_STREAM_MAX_DEPTH
+#define JSON_STREAM_MAX_DEPTH 8
+#endif
+
+#ifndef JSON_STREAM_MAX_PATH
+#define JSON_STREAM_MAX_PATH 64
+#endif
+
+#ifndef JSON_STREAM_MAX_TOKEN
+#define JSON_STREAM_MAX_TOKEN 32
+#endif
+
+/* Lengths and offsets in `struct json_stream` are unsigned char */
+#if JSON_STREAM_MAX_PATH > 255 || JSON_STREAM_MAX_TOKEN > 255
+#error "JSON_STREAM_MAX_PATH and JSON_STREAM_MAX_TOKEN must be at most 255"
+#endif
+
+struct json_stream {
+  json_walk_callback_t callback;
+  void *callback_data;
+  int error;                /* Sticky: first error seen, or 0 */
+  unsigned char state;      /* Internal parser state */
+  unsigned char depth;      /* Number of open objects and arrays */
+  unsigned char escape;     /* Pending escape bytes inside a string */
+  unsigned char token_type; /* enum json_token_type of the buffered token */
+  unsigned char token_skipped; /* String value too long for `token` */
+  char containers[JSON_STREAM_MAX_DEPTH]; /* '{' or '[' per open level */
+  unsigned short indexes[JSON_STREAM_MAX_DEPTH];   /* Next array index */
+  unsigned char path_lens[JSON_STREAM_MAX_DEPTH];  /* Path of each level */
+  unsigned char path_len;
+  unsigned char name_off;   /* Offset of the current name in `path` */
+  unsigned char name_len;
+  unsigned char token_len;
+  char path[JSON_STREAM_MAX_PATH + 1];
+  char token[JSON_STREAM_MAX_TOKEN];
+};
+
+/* Prepare `s` for a new document */
+void json_stream_init(struct json_stream *s, json_walk_callback_t callback,
+                      void *callback_data);
+
+/*
+ * Feed the next `len` bytes of the document.
+ * Return 0, or a negative error code. Errors are sticky: once an error is
+ * returned, further calls return it without parsing.
+ */
+int json_stream_feed(struct json_stream *s, const char *buf, int len);
+
+/*
+ * Signal the end of the document.
+ * Return 0 if exactly one complete value was parsed, JSON_STRING_INCOMPLETE if
+ * the document was cut short, or the sticky error code.
+ */
+int json_stream_end(struct json_stream *s);
+
 /*
  * JSON generation API.
  * struct json_out abstracts output, allowing alternative printing plugins.
@@ -170,6 +253,13 @@ typedef int (*json_printf_callback_t)(struct json_out *, va_list *ap);
  *  - `%H` print quoted hex-encoded string. Accepts a `int`, `const char *`.
  *  - `%M` invokes a json_printf_callback_t function. That callback function
  *  can consume more parameters.
+ *  - `%D` print a fixed-point number. Accepts an `int` holding the value
+ *  scaled by 10^precision, e.g. `%.1D` with 234 prints `23.4`. `%D` alone
+ *  prints the integer. Precision must be a literal from 0 to 9; a larger one
+ *  prints `null`, and `%.*D` is not supported.
+ *
+ * `%d`, `%u`, `%x` and their `l`/`ll` forms without flags or width are
+ * formatted internally; other conversions are delegated to vsnprintf.
  *
  * Return number of bytes printed. If the return value is bigger than the
  * supplied buffer, that is an indicator of overflow. In the overflow case,
@@ -199,6 +289,61 @@ int json_vfprintf(const char *file_name, const char *fmt, va_list ap);
 char *json_asprintf(const char *fmt, ...);
 char *json_vasprintf(const char *fmt, va_list ap);
 
+/*
+ * Arena for zero-heap operation: a caller-owned buffer that the `*_arena`
+ * functions carve their results out of, one after another. Allocations are
+ * byte-aligned and never freed individually; `json_arena_reset()` releases
+ * all of them at once. Example:
+ *
+ * ```c
+ *   char mem[128];
+ *   struct json_arena arena = JSON_ARENA(mem, sizeof(mem));
+ *   char *str = json_arena_printf(&arena, "{a: %d}", 1);
+ *   ...
+ *   json_arena_reset(&arena);
+ * ```
+ */
+struct json_arena {
+  char *buf;
+  size_t size;
+  size_t used;
+};
+
+#define JSON_ARENA(buf, size) \
+  { (buf), (size), 0 }
+
+void json_arena_init(struct json_arena *arena, char *buf, size_t size);
+void json_arena_reset(struct json_arena *arena);
+
+/*
+ * Take `size` bytes from the arena.
+ * Return NULL, leaving the arena unchanged, if they do not fit.
+ */
+void *json_arena_alloc(struct json_arena *arena, size_t size);
+
+/*
+ * Same as json_asprintf, but the 0-terminated result is placed in `arena`.
+ * Return NULL, leaving the arena unchanged, if it does not fit.
+ */
+char *json_arena_printf(struct json_arena *arena, const char *fmt, ...);
+char *json_arena_vprintf(struct json_arena *arena, const char *fmt,
+                         va_list ap);
+
+/*
+ * Number of heap allocations Frozen has made so far, for checking that an
+ * operation does not touch the heap. Always 0 when built with JSON_ZERO_HEAP.
+ */
+unsigned long json_heap_allocs(void);
+
+/*
+ * Format `value / 10^decimals` (decimals 0..9) in decimal into `buf`, which
+ * must hold at least 24 bytes, e.g. value 234 with 1 decimal gives "23.4".
+ * This is the `%D` conversion of json_printf(), for callers that build
+ * payloads by hand. Return the number of characters written, excluding the
+ * terminating NUL.
+ */
+int json_format_fixed(char *buf, long value, int decimals);
+
 /*
  * Helper %M callback that prints contiguous C arrays.
  * Consumes void *array_ptr, size_t array_size, size_t elem_size, char *fmt
@@ -236,6 +381,16 @@ int json_printf_array(struct json_out *, va_list *ap);
 int json_scanf(const char *str, int str_len, const char *fmt, ...);
 int json_vscanf(const char *str, int str_len, const char *fmt, va_list ap);
 
+/*
+ * Same as json_scanf, but %Q, %V and %H results are allocated from `arena`
+ * instead of the heap and must not be free()-d. A conversion whose result
+ * does not fit in the arena is not performed and not counted.
+ */
+int json_scanf_arena(const char *str, int str_len, struct json_arena *arena,
+                     const char *fmt, ...);
+int json_vscanf_arena(const char *str, int str_len, struct json_arena *arena,
+                      const char *fmt, va_list ap);
+
 /* json_scanf's %M handler  */
 typedef void (*json_scanner_t)(const char *str, int len, void *user_data);
 
@@ -247,6 +402,60 @@ typedef void (*json_scanner_t)(const char *str, int len, void *user_data);
 int json_scanf_array_elem(const char *s, int len, const char *path, int index,
                           struct json_token *token);
 
+/*
+ * Tokenize-once API.
+ *
+ * `json_index()` parses the document a single time and stores every value
+ * into a caller-provided array, in document order. Any number of paths can
+ * then be resolved against that index with `json_index_find()` without
+ * parsing the document again.
+ *
+ * Objects and arrays are stored with type JSON_TYPE_OBJECT_END or
+ * JSON_TYPE_ARRAY_END and span the whole container text, i.e. they look like
+ * the token `json_walk()` reports when the container is closed.
+ */
+struct json_index_token {
+  int offset;                /* Offset of the value in the document */
+  int len;                   /* Value length */
+  enum json_token_type type; /* Type of the value, see above for containers */
+  int parent;                /* Index of the enclosing container, -1 for root */
+  int key_offset;            /* Offset of the object key, -1 if no key */
+  int key_len;               /* Object key length */
+};
+
+/*
+ * Tokenize `s, len` into `tokens`, which has room for `max_tokens` entries.
+ * Return the number of tokens stored, JSON_TOO_MANY_TOKENS if the document
+ * has more values than `max_tokens`, or another negative error code if the
+ * document is not valid JSON.
+ */
+int json_index(const char *s, int len, struct json_index_token *tokens,
+               int max_tokens);
+
+/*
+ * Resolve `path` (e.g. "", ".foo", ".foo.bar[2]", same syntax as the paths
+ * given to json_walk() callbacks) against an index built by `json_index()`.
+ * If an object repeats a key, the last occurrence wins.
+ * Return the index of the matching token, or -1 if there is none.
+ */
+int json_index_find(const char *s, const struct json_index_token *tokens,
+                    int num_tokens, const char *path);
+
+/*
+ * Same as json_scanf_arena(), but the index is built into the caller's
+ * `tokens` (room for `max_tokens` entries) instead of the one json_scanf()
+ * keeps on the stack, e.g. a static array in a task with a small stack.
+ * With `tokens` NULL every key is found with its own json_walk(). `arena`
+ * may be NULL to allocate %Q, %V and %H results from the heap. The stack
+ * cost is described at JSON_SCANF_MAX_TOKENS.
+ */
+int json_scanf_index(const char *str, int str_len,
+                     struct json_index_token *tokens, int max_tokens,
+                     struct json_arena *arena, const char *fmt, ...);
+int json_vscanf_index(const char *str, int str_len,
+                      struct json_index_token *tokens, int max_tokens,
+                      struct json_arena *arena, const char *fmt, va_list ap);
+
 /*
  * Unescape JSON-encoded string src,slen into dst, dlen.
  * src and dst may overlap.
@@ -268,6 +477,14 @@ int json_escape(struct json_out *out, const char *str, size_t str_len);
  */
 char *json_fread(const char *file_name);
 
+/*
+ * Read the whole file into `buf`, which has room for `size` bytes, and
+ * 0-terminate it.
+ * Return the file length, or -1 on error or if the file and the terminating
+ * NUL do not fit in `buf`.
+ */
+int json_fread_buf(const char *file_name, char *buf, size_t size);
+
 /*
  * Update given JSON string `s,len` by changing the value at given `json_path`.
  * The result is saved to `out`. If `json_fmt` == NULL, that deletes the key.
@@ -334,10 +551,59 @@ void *json_next_elem(const char *s, int len, void *handle, const char *path,
 #define JSON_MAX_DEPTH 9000
 #endif
 
+/*
+ * Maximum nesting of objects and arrays accepted by `json_walk()` and
+ * everything built on it; deeper documents fail with JSON_DEPTH_LIMIT.
+ *
+ * The parser is iterative: open containers live in a fixed array inside the
+ * parser state rather than on the C stack, so the stack needed by a walk is
+ * the same for every input. On a 32-bit target the parser state is about
+ * JSON_MAX_PATH_LEN + 12 * JSON_MAX_NESTING + 40 bytes (~680 bytes with the
+ * defaults) plus roughly 150 bytes of call frames, to which the walk
+ * callback's own usage must be added.
+ */
+#ifndef JSON_MAX_NESTING
+#define JSON_MAX_NESTING 32
+#endif
+
+/*
+ * Size of the token index `json_scanf()` and `json_scanf_arena()` keep on
+ * the stack, in entries of `struct json_index_token`. Documents with more
+ * values fall back to one `json_walk()` per format key.
+ *
+ * Stack needed by a scanf call on a 32-bit target, all of it released on
+ * return:
+ *   - token index: 24 * JSON_SCANF_MAX_TOKENS (768 bytes by default), only
+ *     in json_scanf() and json_scanf_arena();
+ *   - path and conversion buffers: JSON_MAX_PATH_LEN + ~60 (~320 bytes);
+ *   - one json_walk() at a time: ~830 bytes, see JSON_MAX_NESTING;
+ *   - the conversion itself and a %M scanner: ~100 bytes plus the
+ *     scanner's own usage.
+ * That is about 2 KB for json_scanf() with the defaults and about 1.3 KB
+ * for json_scanf_index(), whose index is passed in by the caller and may
+ * live elsewhere (e.g. a static array). Define JSON_SCANF_MAX_TOKENS as 0 to
+ * make json_scanf() use one walk per key with no index (~1.3 KB too).
+ */
+#ifndef JSON_SCANF_MAX_TOKENS
+#define JSON_SCANF_MAX_TOKENS 32
+#endif
+
 #ifndef JSON_MINIMAL
 #define JSON_MINIMAL 0
 #endif
 
+/*
+ * Never allocate from the heap. json_asprintf(), json_vasprintf(),
+ * json_fread(), json_prettify_file() and the %Q, %V and %H conversions of
+ * plain json_scanf() then fail (return NULL, -1 or skip the conversion);
+ * use the arena and `_buf` variants instead. A conversion json_printf()
+ * delegates to vsnprintf (e.g. `%f`, `%10s`) whose output is longer than
+ * 23 characters would need a temporary heap buffer, so it prints `null`.
+ */
+#ifndef JSON_ZERO_HEAP
+#define JSON_ZERO_HEAP 0
+#endif
+
 #ifndef JSON_ENABLE_BASE64
 #define JSON_ENABLE_BASE64 !JSON_MINIMAL
 #endif
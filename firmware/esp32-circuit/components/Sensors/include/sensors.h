@@ -8,7 +8,9 @@
 typedef struct{
     uint8_t light;
     uint8_t temperature;
+    uint8_t temperature_dec; // Parte decimal (decimas) que devuelve el DHT11
     uint8_t humidicity;
+    uint8_t humidicity_dec;
 }sensor_data_t;
 
 typedef enum{
@@ -33,7 +33,9 @@ eSensor_error readSensors(sensor_data_t* data){
 
         data->light = light;
         data->humidicity = humidicity_int;
+        data->humidicity_dec = humidicity_dec;
         data->temperature = temperature_int;
+        data->temperature_dec = temperature_dec;
 
         return SENSOR_OK;
     }else{
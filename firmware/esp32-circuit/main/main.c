@@ -29,6 +29,13 @@
 static gEventStruct* events_variables = NULL;
 static int delay = MIN_DELAY;
 
+// Nombre de cada estado en el topico de estado (comm_send_status)
+static const char* const state_names[] = {
+    [performance] = "performance",
+    [configuration] = "configuration",
+    [idle] = "idle",
+};
+
 /**
  * Creacion de tareas para controlar el main
  */
@@ -106,7 +113,9 @@ void vSensorsTask(void* pvParameters){
             err = readSensors(&data_sensor);
             if(err == SENSOR_OK){
                 data_telemetry.temperature = data_sensor.temperature;
+                data_telemetry.temperature_dec = data_sensor.temperature_dec;
                 data_telemetry.humicity = data_sensor.humidicity;
+                data_telemetry.humicity_dec = data_sensor.humidicity_dec;
                 data_telemetry.light = data_sensor.light;
                 comm_send_telemetry(&data_telemetry);
                 vTaskDelay(delay);
@@ -149,6 +158,8 @@ void vControlFSMTask(void* pvParameters)
                     break;
             }
             previousState = events_variables->currentState;
+            comm_send_status(state_names[previousState], delay);
+            events_state_applied();
         }
         vTaskDelay(pdMS_TO_TICKS(100));
     }
@@ -163,22 +174,21 @@ void vEventMQTT_Task(void* pvParameters){
         switch (message.message_type)
         {
             case ON:
-                events_variables->currentState = performance;
+                events_set_state(performance, message.received_us);
             break;
             case SLEEP:
-                events_variables->currentState = idle;
+                events_set_state(idle, message.received_us);
             break;
             case CONFIG:
-                events_variables->currentState = configuration;
+                events_set_state(configuration, message.received_us);
             break;
             case DELAY:
                 if(events_variables->currentState == configuration){
-                    const char* json_str = message.data;
-                    int delay_receive;
-                    int result = json_scanf(json_str, strlen(json_str), "{delay: %d}", &delay_receive);
-                    if(result){
-                        delay = delay_receive;
-                        if(delay_receive < MIN_DELAY){
+                    // El payload {delay: value} ya viene parseado por el modulo de comunicaciones
+                    if(message.status == COMM_OK){
+                        delay = message.value;
+                        comm_send_status(state_names[configuration], delay);
+                        if(message.value < MIN_DELAY){
                             comm_send_error(INVALID_DELAY);
                         }
                     }
@@ -0,0 +1,343 @@
+#!/usr/bin/env python3
+"""Fleet RTT sweep over the diag/ping probe.
+
+Pings every device of the fleet through the broker and reports, per device
+and for the whole fleet, the distribution of:
+
+  rtt      time from publishing the ping to receiving the pong (this host)
+  device   tx_us - rx_us from the pong: time spent on the device
+  network  rtt - device: network, access point and broker, both ways
+
+Devices are found from the retained ESP32/<id>/status messages unless --ids
+is given. Pings go round-robin over the devices so a slow moment on the
+network does not fall on a single node. A device is flagged as slow when
+its network p50 is more than --slow times the fleet median.
+
+Only needs Python 3; it speaks MQTT 3.1.1 over a plain TCP socket.
+
+  tools/fleet_sweep.py --host 192.168.1.10 -u user -P pass --count 50
+  tools/fleet_sweep.py --host broker --ids 1-8,12 --json > sweep.json
+"""
+
+import argparse
+import json
+import os
+import select
+import socket
+import statistics
+import struct
+import sys
+import time
+
+# ----- MQTT 3.1.1, just what the sweep needs ----- #
+
+CONNECT, CONNACK, PUBLISH, SUBSCRIBE, SUBACK, PINGREQ, DISCONNECT = 1, 2, 3, 8, 9, 12, 14
+KEEPALIVE_S = 30
+
+
+def encode_length(n):
+    out = bytearray()
+    while True:
+        byte, n = n & 0x7F, n >> 7
+        out.append(byte | (0x80 if n else 0))
+        if not n:
+            return bytes(out)
+
+
+def encode_string(s):
+    data = s.encode() if isinstance(s, str) else s
+    return struct.pack("!H", len(data)) + data
+
+
+class MqttClient:
+    def __init__(self, host, port, client_id, username=None, password=None):
+        self.sock = socket.create_connection((host, port), timeout=10)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = bytearray()
+        self.packet_id = 0
+        self.last_sent = time.monotonic()
+
+        flags = 0x02  # Clean session
+        payload = encode_string(client_id)
+        if username is not None:
+            flags |= 0x80
+            payload += encode_string(username)
+            if password is not None:
+                flags |= 0x40
+                payload += encode_string(password)
+        header = encode_string("MQTT") + bytes([4, flags]) + struct.pack("!H", KEEPALIVE_S)
+        self._send(CONNECT << 4, header + payload)
+        ptype, _, body = self._wait_packet(CONNACK, 10)
+        if len(body) < 2 or body[1] != 0:
+            raise ConnectionError("broker refused the connection (CONNACK %s)" % body.hex())
+
+    def _send(self, first_byte, body):
+        self.sock.sendall(bytes([first_byte]) + encode_length(len(body)) + body)
+        self.last_sent = time.monotonic()
+
+    def _next_packet_id(self):
+        self.packet_id = self.packet_id % 0xFFFF + 1
+        return self.packet_id
+
+    def _parse(self):
+        """Takes one complete packet out of the buffer: (type, flags, body) or None."""
+        length, shift, i = 0, 0, 1
+        while True:
+            if i >= len(self.buf):
+                return None
+            byte = self.buf[i]
+            length |= (byte & 0x7F) << shift
+            shift += 7
+            i += 1
+            if not byte & 0x80:
+                break
+        if len(self.buf) < i + length:
+            return None
+        first = self.buf[0]
+        body = bytes(self.buf[i:i + length])
+        del self.buf[:i + length]
+        return first >> 4, first & 0x0F, body
+
+    def read(self, timeout):
+        """Next packet, or None after timeout seconds. Sends PINGREQ when due."""
+        deadline = time.monotonic() + timeout
+        while True:
+            packet = self._parse()
+            if packet is not None:
+                return packet
+            if time.monotonic() - self.last_sent > KEEPALIVE_S / 2:
+                self._send(PINGREQ << 4, b"")
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            ready, _, _ = select.select([self.sock], [], [], min(left, 1.0))
+            if ready:
+                data = self.sock.recv(65536)
+                if not data:
+                    raise ConnectionError("broker closed the connection")
+                self.buf += data
+
+    def _wait_packet(self, wanted, timeout):
+        deadline = time.monotonic() + timeout
+        while True:
+            packet = self.read(max(0.0, deadline - time.monotonic()))
+            if packet is None:
+                raise TimeoutError("no reply from the broker")
+            if packet[0] == wanted:
+                return packet
+
+    def subscribe(self, topic_filter, on_publish=None):
+        """QoS 0 subscription. PUBLISH packets received before the SUBACK go to on_publish."""
+        packet_id = self._next_packet_id()
+        self._send(SUBSCRIBE << 4 | 0x02, struct.pack("!H", packet_id) + encode_string(topic_filter) + b"\x00")
+        deadline = time.monotonic() + 10
+        while True:
+            packet = self.read(max(0.0, deadline - time.monotonic()))
+            if packet is None:
+                raise TimeoutError("no SUBACK for " + topic_filter)
+            if packet[0] == SUBACK:
+                return
+            if packet[0] == PUBLISH and on_publish is not None:
+                on_publish(*decode_publish(packet[1], packet[2]))
+
+    def publish(self, topic, payload):
+        self._send(PUBLISH << 4, encode_string(topic) + payload)
+
+    def disconnect(self):
+        try:
+            self._send(DISCONNECT << 4, b"")
+        finally:
+            self.sock.close()
+
+
+def decode_publish(flags, body):
+    """(topic, payload, retain) of a PUBLISH body."""
+    (topic_len,) = struct.unpack_from("!H", body)
+    topic = body[2:2 + topic_len].decode(errors="replace")
+    offset = 2 + topic_len + (2 if (flags >> 1) & 0x03 else 0)
+    return topic, body[offset:], bool(flags & 0x01)
+
+
+# ----- Sweep ----- #
+
+def parse_ids(text):
+    ids = set()
+    for part in text.split(","):
+        if "-" in part:
+            first, last = part.split("-", 1)
+            ids.update(range(int(first), int(last) + 1))
+        elif part:
+            ids.add(int(part))
+    return sorted(ids)
+
+
+def discover(client, device, wait_s):
+    """Ids of the devices with a retained status message, i.e. every device that has ever connected."""
+    found = set()
+
+    def on_status(topic, payload, retain):
+        parts = topic.split("/")
+        if len(parts) == 3 and parts[2] == "status" and parts[1].isdigit():
+            found.add(int(parts[1]))
+
+    client.subscribe("%s/+/status" % device, on_status)
+    deadline = time.monotonic() + wait_s
+    while time.monotonic() < deadline:
+        packet = client.read(deadline - time.monotonic())
+        if packet is not None and packet[0] == PUBLISH:
+            on_status(*decode_publish(packet[1], packet[2]))
+    return sorted(found)
+
+
+def sweep(client, device, ids, count, interval_s, timeout_s):
+    """Sends count pings to each id and returns {id: [(rtt_us, device_us), ...]} and the sent counts."""
+    session = os.urandom(3).hex()
+    pending = {}  # nonce -> (id, send time in ns)
+    results = {i: [] for i in ids}
+    sent = {i: 0 for i in ids}
+
+    def on_pong(topic, payload, now_ns):
+        try:
+            pong = json.loads(payload)
+            entry = pending.pop(str(pong["nonce"]), None)
+            rx_us, tx_us = int(pong["rx_us"]), int(pong["tx_us"])
+        except (ValueError, KeyError, TypeError):
+            return
+        if entry is None or entry[0] != pong.get("id"):
+            return
+        rtt_us = (now_ns - entry[1]) / 1000.0
+        results[entry[0]].append((rtt_us, float(tx_us - rx_us)))
+
+    def drain(until):
+        while True:
+            packet = client.read(max(0.0, until - time.monotonic()))
+            if packet is None:
+                return
+            if packet[0] == PUBLISH:
+                now_ns = time.monotonic_ns()
+                topic, payload, retain = decode_publish(packet[1], packet[2])
+                if not retain:
+                    on_pong(topic, payload, now_ns)
+
+    client.subscribe("%s/+/diag/pong" % device)
+    for seq in range(count):
+        for i in ids:
+            nonce = "%s-%d-%d" % (session, i, seq)
+            pending[nonce] = (i, time.monotonic_ns())
+            client.publish("%s/%d/diag/ping" % (device, i), json.dumps({"nonce": nonce}).encode())
+            sent[i] += 1
+            drain(time.monotonic() + interval_s)
+    drain(time.monotonic() + timeout_s)
+    return results, sent
+
+
+def percentile(values, fraction):
+    """Nearest-rank percentile."""
+    if not values:
+        return None
+    ordered = sorted(values)
+    rank = max(1, int(-(-len(ordered) * fraction // 1)))
+    return ordered[rank - 1]
+
+
+def summary(values):
+    if not values:
+        return None
+    return {
+        "p50": round(percentile(values, 0.50), 1),
+        "p90": round(percentile(values, 0.90), 1),
+        "p99": round(percentile(values, 0.99), 1),
+        "max": round(max(values), 1),
+        "mean": round(statistics.fmean(values), 1),
+    }
+
+
+def report(results, sent, slow_factor):
+    devices = {}
+    fleet = {"rtt": [], "device": [], "network": []}
+    for i, samples in results.items():
+        rtt = [s[0] for s in samples]
+        on_device = [s[1] for s in samples]
+        network = [s[0] - s[1] for s in samples]
+        fleet["rtt"] += rtt
+        fleet["device"] += on_device
+        fleet["network"] += network
+        devices[i] = {
+            "sent": sent[i],
+            "received": len(samples),
+            "lost": sent[i] - len(samples),
+            "rtt_us": summary(rtt),
+            "device_us": summary(on_device),
+            "network_us": summary(network),
+        }
+
+    medians = [d["network_us"]["p50"] for d in devices.values() if d["network_us"]]
+    fleet_median = statistics.median(medians) if medians else None
+    for d in devices.values():
+        d["slow"] = bool(fleet_median and d["network_us"] and d["network_us"]["p50"] > slow_factor * fleet_median)
+
+    return {
+        "devices": {str(i): d for i, d in sorted(devices.items())},
+        "fleet": {
+            "sent": sum(sent.values()),
+            "received": len(fleet["rtt"]),
+            "rtt_us": summary(fleet["rtt"]),
+            "device_us": summary(fleet["device"]),
+            "network_us": summary(fleet["network"]),
+        },
+        "slow": [i for i, d in sorted(devices.items()) if d["slow"]],
+        "unreachable": [i for i, d in sorted(devices.items()) if d["received"] == 0],
+    }
+
+
+def ms(value):
+    return "-" if value is None else "%.1f" % (value / 1000.0)
+
+
+def print_table(result, out):
+    columns = ("id", "sent", "lost", "rtt p50", "rtt p99", "net p50", "net p99", "dev p50", "dev p99", "")
+    out.write("%6s %5s %5s %8s %8s %8s %8s %8s %8s %s\n" % columns)
+    rows = list(result["devices"].items()) + [("fleet", dict(result["fleet"], lost=result["fleet"]["sent"] - result["fleet"]["received"]))]
+    for name, d in rows:
+        rtt, net, dev = d["rtt_us"] or {}, d["network_us"] or {}, d["device_us"] or {}
+        out.write("%6s %5d %5d %8s %8s %8s %8s %8s %8s %s\n" % (
+            name, d["sent"], d["lost"], ms(rtt.get("p50")), ms(rtt.get("p99")), ms(net.get("p50")),
+            ms(net.get("p99")), ms(dev.get("p50")), ms(dev.get("p99")), "SLOW" if d.get("slow") else ""))
+    out.write("(ms; net = rtt - (tx_us - rx_us), dev = tx_us - rx_us)\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("-u", "--username")
+    parser.add_argument("-P", "--password")
+    parser.add_argument("--device", default="ESP32", help="topic prefix (DEVICE in board_definition.h)")
+    parser.add_argument("--ids", help="e.g. 1-8,12; default: every id with a retained status")
+    parser.add_argument("--count", type=int, default=20, help="pings per device")
+    parser.add_argument("--interval", type=float, default=50, help="ms between two pings")
+    parser.add_argument("--timeout", type=float, default=3, help="s to wait for the last pongs")
+    parser.add_argument("--slow", type=float, default=3, help="flag devices above this times the fleet median")
+    parser.add_argument("--json", action="store_true", help="print the full report as JSON")
+    args = parser.parse_args()
+
+    client = MqttClient(args.host, args.port, "fleet-sweep-" + os.urandom(3).hex(), args.username, args.password)
+    try:
+        ids = parse_ids(args.ids) if args.ids else discover(client, args.device, 1.0)
+        if not ids:
+            sys.exit("no devices found; pass --ids")
+        results, sent = sweep(client, args.device, ids, args.count, args.interval / 1000.0, args.timeout)
+    finally:
+        client.disconnect()
+
+    result = report(results, sent, args.slow)
+    if args.json:
+        json.dump(result, sys.stdout, indent=2)
+        sys.stdout.write("\n")
+    else:
+        print_table(result, sys.stdout)
+    return 1 if result["unreachable"] else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())